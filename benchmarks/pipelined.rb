@@ -67,7 +67,7 @@ def benchmark_h1p_parser(iterations)
   STDOUT << "H1P parser: "
   require_relative '../lib/h1p'
   i, o = IO.pipe
-  parser = H1P::Parser.new(i)
+  parser = H1P::Parser.new(i, :server)
   req_count = 0
 
   writer = Thread.new do
@@ -83,6 +83,27 @@ def benchmark_h1p_parser(iterations)
   puts(format('count: %d, elapsed: %f, allocated: %d (%f/req), rate: %f ips', req_count, elapsed, allocated, allocated.to_f / iterations, iterations / elapsed))
 end
 
+def benchmark_h1p_parser_batched(iterations)
+  STDOUT << "H1P parser (batched): "
+  require_relative '../lib/h1p'
+  i, o = IO.pipe
+  parser = H1P::Parser.new(i, :server)
+  req_count = 0
+
+  writer = Thread.new do
+    iterations.times { o << HTTP_REQUEST }
+    o.close
+  end
+
+  elapsed, allocated = measure_time_and_allocs do
+    while (headers = parser.parse_headers)
+      req_count += 1
+      req_count += parser.parse_buffered_requests.size
+    end
+  end
+  puts(format('count: %d, elapsed: %f, allocated: %d (%f/req), rate: %f ips', req_count, elapsed, allocated, allocated.to_f / iterations, iterations / elapsed))
+end
+
 def fork_benchmark(method, iterations)
   pid = fork do
     send(method, iterations)
@@ -97,5 +118,6 @@ end
 x = 100000
 fork_benchmark(:benchmark_other_http1_parser, x)
 fork_benchmark(:benchmark_h1p_parser, x)
+fork_benchmark(:benchmark_h1p_parser_batched, x)
 
 # benchmark_h1p_parser(x)
\ No newline at end of file
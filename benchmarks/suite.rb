@@ -0,0 +1,188 @@
+# frozen_string_literal: true
+
+# Parser benchmark suite. Each scenario feeds a prebuilt corpus from memory to
+# the parser through a callable reader, so that results are not affected by
+# pipe or thread scheduling overhead. Usage:
+#
+#   ruby benchmarks/suite.rb [--duration SECS] [--filter PATTERN] [--output FILE]
+#
+# Results are printed as a table, and written as JSON to the given output file
+# (or to STDOUT if the output file is `-`), for tracking regressions across
+# releases.
+
+require 'json'
+require 'optparse'
+require_relative '../lib/h1p'
+
+module H1PBenchmark
+  BROWSER_HEADERS = [
+    'Host: www.example.com',
+    'User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36',
+    'Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8',
+    'Accept-Language: en-US,en;q=0.9,fr;q=0.8,de;q=0.7',
+    'Accept-Encoding: gzip, deflate, br',
+    'Cache-Control: max-age=0',
+    'Connection: keep-alive',
+    'Sec-Ch-Ua: "Not_A Brand";v="8", "Chromium";v="120", "Google Chrome";v="120"',
+    'Sec-Ch-Ua-Mobile: ?0',
+    'Sec-Ch-Ua-Platform: "macOS"',
+    'Sec-Fetch-Dest: document',
+    'Sec-Fetch-Mode: navigate',
+    'Sec-Fetch-Site: same-origin',
+    'Sec-Fetch-User: ?1',
+    'Upgrade-Insecure-Requests: 1',
+    'Referer: https://www.example.com/articles/2024/01/some-article-with-a-rather-long-slug?utm_source=newsletter&utm_medium=email',
+    'Cookie: session=0123456789abcdef0123456789abcdef; _ga=GA1.2.1234567890.1234567890; _gid=GA1.2.0987654321.0987654321; theme=dark; locale=en-US'
+  ].freeze
+
+  def self.request(path, headers, body = nil)
+    head = +"#{body ? 'POST' : 'GET'} #{path} HTTP/1.1\r\n"
+    headers.each { head << _1 << "\r\n" }
+    head << "\r\n"
+    body ? head << body : head
+  end
+
+  def self.browser_request
+    req = request('/articles/2024/01/some-article-with-a-rather-long-slug?page=2&sort=desc', BROWSER_HEADERS)
+    # pad to ~2KB with additional headers
+    extra = []
+    i = 0
+    while req.bytesize + extra.sum { _1.bytesize + 2 } < 2048
+      extra << "X-Custom-Header-#{i}: #{'v' * 48}"
+      i += 1
+    end
+    request('/articles/2024/01/some-article-with-a-rather-long-slug?page=2&sort=desc', BROWSER_HEADERS + extra)
+  end
+
+  def self.cookie_request
+    cookies = 8.times.map { |i| "Cookie: #{(0...16).map { |j| "c#{i}_#{j}=#{'x' * 48}" }.join('; ')}" }
+    request('/account', ['Host: www.example.com', *cookies])
+  end
+
+  def self.chunked_upload(size, chunk_size)
+    chunks = +''
+    left = size
+    while left > 0
+      len = [left, chunk_size].min
+      chunks << "#{len.to_s(16)}\r\n#{'x' * len}\r\n"
+      left -= len
+    end
+    chunks << "0\r\n\r\n"
+    request('/upload', ['Host: www.example.com', 'Transfer-Encoding: chunked'], chunks)
+  end
+
+  # Each scenario has a single message (fed to the parser one message per read)
+  # or a burst of pipelined messages (fed to the parser in a single read).
+  SCENARIOS = {
+    'minimal_get'           => { message: request('/', ['Host: a']) },
+    'browser_2kb'           => { message: browser_request },
+    'cookies_8kb'           => { message: cookie_request },
+    'chunked_upload_1kb'    => { message: chunked_upload(1 << 10, 256), body: true },
+    'chunked_upload_64kb'   => { message: chunked_upload(1 << 16, 4096), body: true },
+    'chunked_upload_1mb'    => { message: chunked_upload(1 << 20, 16384), body: true },
+    'pipelined_burst_16'    => { message: request('/', ['Host: www.example.com', 'Accept: */*']), burst: 16 },
+    'pipelined_burst_64'    => { message: request('/', ['Host: www.example.com', 'Accept: */*']), burst: 64 }
+  }.freeze
+
+  def self.allocated_objects
+    GC.stat(:total_allocated_objects)
+  end
+
+  def self.clock
+    Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  end
+
+  # Parses `count` messages (or bursts), returning the number of requests
+  # parsed.
+  def self.run_scenario(scenario, count)
+    message = scenario[:message]
+    burst = scenario[:burst]
+    data = burst ? message * burst : message
+    left = count
+    parser = H1P::Parser.new(proc { (left -= 1) >= 0 ? data : nil }, :server)
+
+    requests = 0
+    if burst
+      while parser.parse_headers
+        requests += 1 + parser.parse_buffered_requests.size
+      end
+    else
+      while parser.parse_headers
+        parser.read_body if scenario[:body]
+        requests += 1
+      end
+    end
+    requests
+  end
+
+  def self.measure(name, scenario, duration)
+    message_size = scenario[:message].bytesize
+
+    # warmup, and calibrate batch size to ~10ms
+    batch = 1
+    loop do
+      t0 = clock
+      run_scenario(scenario, batch)
+      break if clock - t0 > 0.01 || batch >= 1 << 20
+      batch *= 2
+    end
+
+    requests = 0
+    allocated = 0
+    elapsed = 0
+    while elapsed < duration
+      a0 = allocated_objects
+      t0 = clock
+      requests += run_scenario(scenario, batch)
+      elapsed += clock - t0
+      allocated += allocated_objects - a0
+    end
+
+    {
+      name: name,
+      requests: requests,
+      message_bytes: message_size,
+      requests_per_sec: (requests / elapsed).round(1),
+      ns_per_request: (elapsed * 1e9 / requests).round(1),
+      ns_per_byte: (elapsed * 1e9 / (requests * message_size)).round(3),
+      bytes_per_sec: (requests * message_size / elapsed).round,
+      allocations_per_request: (allocated.to_f / requests).round(2)
+    }
+  end
+
+  def self.run(duration:, filter:, output:)
+    results = SCENARIOS.select { |name, _| !filter || name =~ filter }.map do |name, scenario|
+      measure(name, scenario, duration).tap { print_result(_1) }
+    end
+    report = {
+      h1p_version: H1P::VERSION,
+      ruby_version: RUBY_DESCRIPTION,
+      time: Time.now.utc.iso8601,
+      results: results
+    }
+    json = JSON.pretty_generate(report)
+    output == '-' ? puts(json) : File.write(output, json) if output
+  end
+
+  def self.print_result(r)
+    puts format(
+      '%-22s %12.1f req/s %10.1f ns/req %8.3f ns/B %9.1f MB/s %8.2f allocs/req',
+      r[:name], r[:requests_per_sec], r[:ns_per_request], r[:ns_per_byte],
+      r[:bytes_per_sec] / 1e6, r[:allocations_per_request]
+    )
+  end
+end
+
+if __FILE__ == $0
+  require 'time'
+  require_relative '../lib/h1p/version'
+
+  options = { duration: 1.0, filter: nil, output: nil }
+  OptionParser.new do |opts|
+    opts.on('--duration SECS', Float, 'Measurement duration per scenario') { options[:duration] = _1 }
+    opts.on('--filter PATTERN', 'Run only scenarios matching pattern') { options[:filter] = Regexp.new(_1) }
+    opts.on('--output FILE', 'Write JSON results to file (- for STDOUT)') { options[:output] = _1 }
+  end.parse!
+
+  H1PBenchmark.run(**options)
+end
@@ -9,5 +9,12 @@ CONFIG['optflags'] << ' -fno-strict-aliasing' unless RUBY_PLATFORM =~ /mswin/
 require_relative './limits'
 H1P_LIMITS.each { |k, v| $defs << "-D#{k.upcase}=#{v}" }
 
+have_func('rb_hash_new_capa', 'ruby.h')
+have_func('rb_io_descriptor', 'ruby/io.h')
+have_func('rb_io_read_pending', 'ruby/io.h')
+have_func('rb_io_maybe_wait_readable', 'ruby/io.h')
+have_func('rb_fiber_scheduler_current', 'ruby/fiber/scheduler.h')
+have_func('memfd_create', 'sys/mman.h')
+
 dir_config 'h1p_ext'
 create_makefile 'h1p_ext'
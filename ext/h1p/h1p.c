@@ -1,5 +1,19 @@
 #include <stdnoreturn.h>
 #include "h1p.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include "ruby/encoding.h"
+#include "ruby/io.h"
+#include "ruby/thread.h"
+#ifdef HAVE_RB_FIBER_SCHEDULER_CURRENT
+#include "ruby/fiber/scheduler.h"
+#endif
+#include "header_names.h"
 
 // Security-related limits are defined in limits.rb and injected as
 // defines in extconf.rb
@@ -7,8 +21,41 @@
 #define INITIAL_BUFFER_SIZE     4096
 #define BUFFER_TRIM_MIN_LEN     4096
 #define BUFFER_TRIM_MIN_POS     2048
-#define MAX_HEADERS_READ_LENGTH 4096
+// Default limit for the adaptive header read size
+#define MAX_HEADERS_READ_LENGTH (1 << 16) // 64KB
+#define MIN_BUFFER_SIZE         256
+#define RING_BUFFER_DEFAULT_SIZE (1 << 16) // 64KB
+#define MAX_RING_BUFFER_SIZE    (1 << 24) // 16MB
 #define MAX_BODY_READ_LENGTH    (1 << 20) // 1MB
+#define MAX_HEADER_LINE_LENGTH  (MAX_HEADER_KEY_LENGTH + MAX_HEADER_VALUE_LENGTH + 16)
+// The trailer section is limited like the header section: in the number of
+// fields, and in total size to the default header read size.
+#define MAX_TRAILERS_LENGTH     MAX_HEADERS_READ_LENGTH
+#define MAX_CHUNK_HEADER_LENGTH (MAX_CHUNKED_ENCODING_CHUNK_SIZE_LENGTH + MAX_CHUNK_EXTENSIONS_LENGTH + 2)
+#define NOGVL_READ_MIN_LENGTH   (1 << 16) // 64KB
+
+// The header count running average is kept in fixed point, with each new count
+// weighted at 1/8.
+#define HEADER_COUNT_AVG_SHIFT  3
+#define HEADER_COUNT_AVG_INIT   (8 << HEADER_COUNT_AVG_SHIFT)
+#define PSEUDO_HEADER_COUNT     4
+
+#if defined(HAVE_RB_IO_DESCRIPTOR) && defined(HAVE_RB_IO_READ_PENDING) && \
+    defined(HAVE_RB_IO_MAYBE_WAIT_READABLE)
+#define H1P_NATIVE_IO
+#endif
+
+#if !defined(H1P_NATIVE_IO)
+#undef H1P_RING_BUFFER
+#endif
+
+#if defined(H1P_NATIVE_IO) && defined(__linux__)
+#include <sys/sendfile.h>
+#define H1P_NATIVE_SPLICE
+#define H1P_NATIVE_SENDFILE
+#define SPLICE_CHUNK_SIZE       (1 << 16) // 64KB (default pipe capacity)
+#define SENDFILE_CHUNK_SIZE     (1 << 20) // 1MB
+#endif
 
 #define BODY_READ_MODE_UNKNOWN  -2
 #define BODY_READ_MODE_CHUNKED  -1
@@ -20,10 +67,29 @@ ID ID_backend_send;
 ID ID_backend_splice;
 ID ID_backend_write;
 ID ID_call;
+ID ID_date;
 ID ID_downcase;
 ID ID_eof_p;
-ID ID_eq;
+ID ID_flush_threshold;
 ID ID_join;
+ID ID_body_done;
+ID ID_first_byte;
+ID ID_headers_done;
+ID ID_allocated;
+ID ID_buffer_pool;
+ID ID_free;
+ID ID_in_use;
+ID ID_max_free;
+ID ID_size;
+ID ID_sizes;
+ID ID_lazy;
+ID ID_max_read_size;
+ID ID_ring_buffer;
+ID ID_min_buffer_size;
+ID ID_timings;
+ID ID_length;
+ID ID_offset;
+ID ID_range;
 ID ID_read_method;
 ID ID_read;
 ID ID_readpartial;
@@ -37,7 +103,6 @@ static VALUE cError;
 
 VALUE eArgumentError;
 
-VALUE NUM_max_headers_read_length;
 VALUE NUM_buffer_start;
 VALUE NUM_buffer_end;
 
@@ -50,15 +115,27 @@ VALUE STR_pseudo_status;
 VALUE STR_pseudo_status_default;
 VALUE STR_pseudo_status_message;
 
+VALUE STR_method_get;
+VALUE STR_method_post;
+VALUE STR_method_put;
+VALUE STR_method_head;
+VALUE STR_method_patch;
+VALUE STR_method_delete;
+VALUE STR_method_options;
+VALUE STR_protocol_http_1_0;
+VALUE STR_protocol_http_1_1;
+
 VALUE STR_chunked;
-VALUE STR_content_length;
 VALUE STR_content_length_capitalized;
-VALUE STR_transfer_encoding;
 VALUE STR_transfer_encoding_capitalized;
+VALUE STR_content_range_capitalized;
+VALUE STR_status_partial_content;
+VALUE STR_status_range_not_satisfiable;
 
 VALUE STR_CRLF;
 VALUE STR_EMPTY_CHUNK;
 VALUE STR_COMMA_SPACE;
+VALUE STR_released_buffer;
 
 VALUE SYM_backend_read;
 VALUE SYM_backend_recv;
@@ -67,19 +144,33 @@ VALUE SYM_backend_write;
 VALUE SYM_stock_readpartial;
 
 VALUE SYM_client;
+VALUE SYM_need_more;
 VALUE SYM_server;
 
+static rb_encoding *enc_utf8;
+
+// Maps header name (token) characters to lowercase, and any other character to
+// 0. Initialized in Init_H1P.
+static unsigned char token_lower[256];
+
+// Preallocated frozen keys for the well-known header names in header_names.h
+static VALUE header_name_strs[HEADER_NAME_COUNT];
+
 enum read_method {
   RM_READPARTIAL,       // receiver.readpartial(len, buf, pos, raise_on_eof: false) (Polyphony-specific)
   RM_BACKEND_READ,      // Polyphony.backend_read (Polyphony-specific)
   RM_BACKEND_RECV,      // Polyphony.backend_recv (Polyphony-specific)
   RM_CALL,              // receiver.call(len) (Universal)
-  RM_STOCK_READPARTIAL  // receiver.readpartial(len)
+  RM_STOCK_READPARTIAL, // receiver.readpartial(len)
+  RM_NATIVE,            // read(2) on the receiver's fd (non-blocking IO instances)
+  RM_NATIVE_BLOCKING    // read(2) without the GVL (blocking IO instances)
 };
 
 enum write_method {
-  WM_BACKEND_WRITE,
-  WM_BACKEND_SEND
+  WM_BACKEND_WRITE,     // Polyphony.backend_write (Polyphony-specific)
+  WM_BACKEND_SEND,      // Polyphony.backend_send (Polyphony-specific)
+  WM_NATIVE,            // write(2) / splice(2) on the receiver's fd (non-blocking IO instances)
+  WM_NATIVE_BLOCKING    // write(2) / splice(2) without the GVL (blocking IO instances)
 };
 
 enum parser_mode {
@@ -87,39 +178,195 @@ enum parser_mode {
   mode_client
 };
 
+// Push mode parser states
+enum push_state {
+  PUSH_START_LINE,      // request line / status line
+  PUSH_HEADERS,         // header lines
+  PUSH_BODY,            // body with content length
+  PUSH_CHUNK_SIZE,      // chunk size line
+  PUSH_CHUNK_DATA,      // chunk data
+  PUSH_TRAILERS,        // trailer fields following the last chunk
+  PUSH_CR,              // CR or LF expected, followed by push_next_state
+  PUSH_LF               // LF expected, followed by push_next_state
+};
+
+// Framing flags, set while parsing the start line and headers
+#define FRAMING_HTTP_1_1                (1 << 0)
+#define FRAMING_CHUNKED                 (1 << 1) // chunked is the last transfer coding
+#define FRAMING_CONNECTION_CLOSE        (1 << 2)
+#define FRAMING_CONNECTION_KEEP_ALIVE   (1 << 3)
+#define FRAMING_CONNECTION_UPGRADE      (1 << 4)
+#define FRAMING_UPGRADE                 (1 << 5) // Upgrade header present
+#define FRAMING_EXPECT_CONTINUE         (1 << 6)
+#define FRAMING_INVALID_CONTENT_LENGTH  (1 << 7)
+
+enum parse_error {
+  ERR_START_LINE,       // invalid request line / status line
+  ERR_HEADER,           // invalid header, or too many headers
+  ERR_BODY,             // invalid content length or chunked encoding
+  ERR_INCOMPLETE_BODY,  // EOF while reading body
+  ERR_COUNT
+};
+
+// Parser instrumentation counters. The counters are updated under the GVL (and
+// parsers are only used from the main Ractor), so no synchronization is needed.
+typedef struct parser_stats {
+  uint64_t reads;             // read calls (or pushed segments)
+  uint64_t bytes_read;        // bytes read into Ruby strings
+  uint64_t buffer_refills;    // reads into the parser's buffer
+  uint64_t buffer_trims;      // buffer trims involving a memmove
+  uint64_t buffer_bytes_moved;
+  uint64_t buffer_high_water; // max buffer capacity
+  uint64_t requests;          // messages parsed
+  uint64_t body_bytes_read;
+  uint64_t body_bytes_spliced;
+  uint64_t errors[ERR_COUNT];
+} parser_stats_t;
+
+// Counters aggregated across all parsers
+static parser_stats_t h1p_stats;
+
+#define STATS_ADD(parser, field, n) { \
+  (parser)->stats.field += (n); \
+  h1p_stats.field += (n); \
+}
+
+#define STATS_MAX(parser, field, v) { \
+  if ((uint64_t)(v) > (parser)->stats.field) (parser)->stats.field = (v); \
+  if ((uint64_t)(v) > h1p_stats.field) h1p_stats.field = (v); \
+}
+
 typedef struct parser {
   enum  parser_mode mode;
   VALUE io;
   VALUE buffer;
   VALUE headers;
-  int   current_request_rx;
+  VALUE trailers; // trailer fields of a chunked body (or nil)
+  int   trailer_count;
+  int   trailer_len;
+  int   lazy;
+  // Adaptive buffer sizing: the read size starts at min_buffer_size and grows
+  // (up to max_read_size) with the size of incoming messages. An empty buffer
+  // is shrunk back to min_buffer_size before waiting for the next message.
+  int   read_size;
+  int   min_buffer_size;
+  int   max_read_size;
+  int   buffered_only; // set while parsing buffered requests, prevents reading
+  int   request_pos;
+  // Body lengths and byte counts are 64-bit, so bodies larger than 2GB can be
+  // read or spliced.
+  int64_t current_request_rx;
+  int   header_count_avg;
 
   enum  read_method read_method;
-  int   body_read_mode;
-  int   body_left;
+  int64_t body_read_mode;
+  int   framing;          // framing flags for the current message
+  int64_t content_length; // content length of the current message, or -1
+  int64_t body_left;
   int   request_completed;
 
   char *buf_ptr;
   int   buf_len;
   int   buf_pos;
 
+  int   splice_pipe[2]; // internal pipe used for native splicing
+
+  int   push;               // push mode (no associated IO)
+  enum  push_state push_state;
+  enum  push_state push_next_state;
+  int   scan_pos;           // resume position for line end search
+  int   push_header_count;
+
+  parser_stats_t stats;
+
+  // Buffer pool used for borrowing read buffers (or nil), and the size class
+  // of the borrowed buffer (or -1 if not borrowed). The pool struct is
+  // referenced separately, so that a borrowed buffer can be accounted for when
+  // the parser is freed, even if the pool object was freed first.
+  VALUE buffer_pool;
+  struct buffer_pool *pool;
+  int   buffer_class;
+
+  // Mirrored ring buffer used instead of the buffer string (or NULL). The
+  // buffered data starts at ring + ring_head, and is always contiguous.
+  char   *ring;
+  size_t  ring_size;
+  size_t  ring_head;
+
+  // Monotonic timestamps (in ns) for the current message, recorded if timings
+  // are enabled. A zero value means the event did not yet happen.
+  int      timings;
+  uint64_t ts_first_byte;
+  uint64_t ts_headers_done;
+  uint64_t ts_body_done;
 } Parser_t;
 
+static inline uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Resets the message timestamps at the start of a new message. If data for the
+// message is already buffered, the first byte is considered seen now.
+static inline void timings_message_start(Parser_t *parser) {
+  if (!parser->timings) return;
+  parser->ts_first_byte = (parser->buf_len > parser->buf_pos) ? monotonic_ns() : 0;
+  parser->ts_headers_done = parser->ts_body_done = 0;
+}
+
+// Called when new data arrives.
+static inline void timings_data_received(Parser_t *parser) {
+  if (parser->timings && !parser->ts_first_byte) parser->ts_first_byte = monotonic_ns();
+}
+
+static inline void timings_record(Parser_t *parser, uint64_t *ts) {
+  if (parser->timings) *ts = monotonic_ns();
+}
+
+static inline void set_request_completed(Parser_t *parser) {
+  parser->request_completed = 1;
+  timings_record(parser, &parser->ts_body_done);
+}
+
 VALUE cParser = Qnil;
+VALUE cHeaders = Qnil;
+VALUE cResponseTemplate = Qnil;
+VALUE cChunkedWriter = Qnil;
+VALUE cBufferPool = Qnil;
 
 static void Parser_mark(void *ptr) {
   Parser_t *parser = ptr;
   rb_gc_mark(parser->io);
   rb_gc_mark(parser->buffer);
   rb_gc_mark(parser->headers);
+  rb_gc_mark(parser->trailers);
+  rb_gc_mark(parser->buffer_pool);
+}
+
+static void splice_pipe_close(Parser_t *parser) {
+  if (parser->splice_pipe[0] == -1) return;
+
+  close(parser->splice_pipe[0]);
+  close(parser->splice_pipe[1]);
+  parser->splice_pipe[0] = parser->splice_pipe[1] = -1;
 }
 
+static void buffer_pool_unref(struct buffer_pool *pool, int class_idx);
+
 static void Parser_free(void *ptr) {
+  Parser_t *parser = ptr;
+  splice_pipe_close(parser);
+  if (parser->pool) buffer_pool_unref(parser->pool, parser->buffer_class);
+#ifdef H1P_RING_BUFFER
+  if (parser->ring) ring_unmap(parser->ring, parser->ring_size);
+#endif
   xfree(ptr);
 }
 
 static size_t Parser_size(const void *ptr) {
-  return sizeof(Parser_t);
+  const Parser_t *parser = ptr;
+  return sizeof(Parser_t) + (parser->ring ? parser->ring_size : 0);
 }
 
 static const rb_data_type_t Parser_type = {
@@ -132,12 +379,95 @@ static VALUE Parser_allocate(VALUE klass) {
   Parser_t *parser;
 
   parser = ALLOC(Parser_t);
+  parser->splice_pipe[0] = parser->splice_pipe[1] = -1;
+  parser->buffer_pool = Qnil;
+  parser->pool = NULL;
+  parser->ring = NULL;
+  memset(&parser->stats, 0, sizeof(parser_stats_t));
   return TypedData_Wrap_Struct(klass, &Parser_type, parser);
 }
 
 #define GetParser(obj, parser) \
   TypedData_Get_Struct((obj), Parser_t, &Parser_type, (parser))
 
+#define BUFFER_POOL_MAX_CLASSES 8
+
+// A pool of read buffers in a number of size classes. Pool operations are done
+// under the GVL, so no locking is needed.
+typedef struct buffer_pool {
+  int   class_count;
+  int   max_free;                           // max free buffers per class
+  int   sizes[BUFFER_POOL_MAX_CLASSES];
+  VALUE free[BUFFER_POOL_MAX_CLASSES];      // arrays of free buffers
+  long  in_use[BUFFER_POOL_MAX_CLASSES];
+  long  allocated[BUFFER_POOL_MAX_CLASSES];
+  long  refs; // references by the pool object and by parsers using the pool
+} BufferPool_t;
+
+// Drops a reference to the pool struct, returning a buffer borrowed from the
+// given size class (or -1 for none) to the in use count. The struct is freed
+// once the pool object and all parsers using the pool are freed.
+static void buffer_pool_unref(BufferPool_t *pool, int class_idx) {
+  if (class_idx >= 0) pool->in_use[class_idx]--;
+  if (!--pool->refs) xfree(pool);
+}
+
+static void BufferPool_mark(void *ptr) {
+  BufferPool_t *pool = ptr;
+  for (int i = 0; i < pool->class_count; i++) rb_gc_mark(pool->free[i]);
+}
+
+static void BufferPool_free(void *ptr) {
+  buffer_pool_unref(ptr, -1);
+}
+
+static const rb_data_type_t BufferPool_type = {
+  "BufferPool",
+  {BufferPool_mark, BufferPool_free, 0,},
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+#define GetBufferPool(obj, pool) \
+  TypedData_Get_Struct((obj), BufferPool_t, &BufferPool_type, (pool))
+
+// Returns a buffer of at least the given size (or of the largest size class),
+// setting *class_idx to its size class. If no free buffer is available, a new
+// one is allocated.
+static VALUE BufferPool_get(VALUE self, int size, int *class_idx) {
+  BufferPool_t *pool;
+  GetBufferPool(self, pool);
+
+  int i = 0;
+  while (i < pool->class_count - 1 && pool->sizes[i] < size) i++;
+  *class_idx = i;
+  pool->in_use[i]++;
+  if (RARRAY_LEN(pool->free[i])) return rb_ary_pop(pool->free[i]);
+
+  pool->allocated[i]++;
+  return rb_str_buf_new(pool->sizes[i]);
+}
+
+// Returns a buffer to the pool. class_idx is the size class the buffer was
+// taken from, or -1 for buffers not taken from the pool. The buffer is put in
+// the largest size class it can hold (after being shrunk if it was grown past
+// twice that size), or dropped if that class is full.
+static void BufferPool_put(VALUE self, VALUE buf, int class_idx) {
+  BufferPool_t *pool;
+  GetBufferPool(self, pool);
+
+  if (class_idx >= 0) pool->in_use[class_idx]--;
+  if (OBJ_FROZEN(buf)) return;
+
+  size_t capa = rb_str_capacity(buf);
+  int i = pool->class_count - 1;
+  while (i >= 0 && (size_t)pool->sizes[i] > capa) i--;
+  if (i < 0 || RARRAY_LEN(pool->free[i]) >= pool->max_free) return;
+
+  if (capa > (size_t)pool->sizes[i] * 2) rb_str_resize(buf, pool->sizes[i]);
+  rb_str_set_len(buf, 0);
+  rb_ary_push(pool->free[i], buf);
+}
+
 static inline VALUE Polyphony(void) {
   static VALUE mPolyphony = Qnil;
   if (mPolyphony == Qnil) {
@@ -147,10 +477,36 @@ static inline VALUE Polyphony(void) {
   return mPolyphony;
 }
 
+// Returns 1 if the given IO instance has a non-blocking fd, 0 if its fd is
+// blocking, or -1 if it cannot be accessed natively.
+static inline int native_io_nonblock_p(VALUE io) {
+#ifdef H1P_NATIVE_IO
+  if (!RB_TYPE_P(io, T_FILE)) return -1;
+
+  int flags = fcntl(rb_io_descriptor(io), F_GETFL);
+  if (flags == -1) return -1;
+  return (flags & O_NONBLOCK) ? 1 : 0;
+#else
+  return -1;
+#endif
+}
+
+// Returns the read method for an IO instance, reading directly from its file
+// descriptor if possible. For non-blocking fds the reading thread waits for
+// readiness using rb_io_maybe_wait_readable (which also cooperates with the
+// fiber scheduler). Blocking fds are read with the GVL released.
+static inline enum read_method detect_native_read_method(VALUE io) {
+  switch (native_io_nonblock_p(io)) {
+    case 1:   return RM_NATIVE;
+    case 0:   return RM_NATIVE_BLOCKING;
+    default:  return RM_STOCK_READPARTIAL;
+  }
+}
+
 static enum read_method detect_read_method(VALUE io) {
   if (rb_respond_to(io, ID_read_method)) {
     VALUE method = rb_funcall(io, ID_read_method, 0);
-    if (method == SYM_stock_readpartial) return RM_STOCK_READPARTIAL;
+    if (method == SYM_stock_readpartial) return detect_native_read_method(io);
     if (method == SYM_backend_read)      return RM_BACKEND_READ;
     if (method == SYM_backend_recv)      return RM_BACKEND_RECV;
 
@@ -169,7 +525,11 @@ static enum write_method detect_write_method(VALUE io) {
     if (method == SYM_backend_write)  return WM_BACKEND_WRITE;
     if (method == SYM_backend_send)   return WM_BACKEND_SEND;
   }
-  rb_raise(rb_eRuntimeError, "Provided io should respond to #__write_method__");
+  switch (native_io_nonblock_p(io)) {
+    case 1:   return WM_NATIVE;
+    case 0:   return WM_NATIVE_BLOCKING;
+  }
+  rb_raise(rb_eRuntimeError, "Provided io should be an IO instance or respond to #__write_method__");
 }
 
 enum parser_mode parse_parser_mode(VALUE mode) {
@@ -179,27 +539,124 @@ enum parser_mode parse_parser_mode(VALUE mode) {
   rb_raise(rb_eRuntimeError, "Invalid parser mode specified");
 }
 
+// Sets up a ring buffer of the given size for parsers reading from native IO.
+// Other parsers use the buffer string.
+static void parser_ring_init(Parser_t *parser, long size) {
+#ifdef H1P_RING_BUFFER
+  if (parser->read_method != RM_NATIVE && parser->read_method != RM_NATIVE_BLOCKING) return;
+
+  size_t ring_size = size;
+  char *ring = ring_map(&ring_size);
+  if (!ring) rb_sys_fail("ring_map");
+
+  if (parser->ring) ring_unmap(parser->ring, parser->ring_size);
+  parser->ring = ring;
+  parser->ring_size = ring_size;
+  parser->ring_head = 0;
+  STATS_MAX(parser, buffer_high_water, ring_size);
+#endif
+}
+
 /* call-seq:
- *   parser.initialize(io, mode)
+ *   parser.initialize(io, mode, **opts)
  *
  * Initializes a new parser with the given IO instance and mode. Mode is either
- * `:server` or `:client`.
+ * `:server` or `:client`. If `io` is nil, the parser works in push mode, with
+ * data fed to it using `#<<`. The following options are accepted:
+ *
+ * - `lazy`: if true, `#parse_headers` returns an `H1P::Headers` instance,
+ *   which creates header strings only when accessed.
+ * - `timings`: if true, the parser records timestamps for each message, which
+ *   can be retrieved using `#timings`.
+ * - `min_buffer_size`: the initial read size, and the size to which the buffer
+ *   is shrunk when idle (default: 4096).
+ * - `max_read_size`: the maximum size of header reads, which grows with the
+ *   size of incoming messages (default: 65536).
+ * - `buffer_pool`: an `H1P::BufferPool` instance, from which the parser borrows
+ *   its buffer while a message is being read. The buffer is returned to the
+ *   pool once fully consumed.
+ * - `ring_buffer`: if true (or an integer size), the parser reads into a
+ *   mirrored ring buffer (default size: 65536), so consumed data is discarded
+ *   without moving leftover data. Used only for native IO on Linux, and ignored
+ *   otherwise.
  */
-VALUE Parser_initialize(VALUE self, VALUE io, VALUE mode) {
+VALUE Parser_initialize(int argc, VALUE *argv, VALUE self) {
   Parser_t *parser;
+  VALUE io, mode, opts;
+  long ring_size = 0;
   GetParser(self, parser);
 
+  rb_scan_args(argc, argv, "2:", &io, &mode, &opts);
+
   parser->mode = parse_parser_mode(mode);
   parser->io = io;
   parser->buffer = rb_str_new_literal("");
   parser->headers = Qnil;
+  parser->lazy = 0;
+  parser->timings = 0;
+  parser->ts_first_byte = parser->ts_headers_done = parser->ts_body_done = 0;
+  parser->push = (io == Qnil);
+  // in push mode data is never read, only appended using #<<
+  parser->buffered_only = parser->push;
+  parser->push_state = PUSH_START_LINE;
+  parser->push_next_state = PUSH_START_LINE;
+  parser->scan_pos = 0;
+  parser->push_header_count = 0;
+  parser->request_completed = 0;
+  parser->header_count_avg = HEADER_COUNT_AVG_INIT;
+
+  parser->min_buffer_size = INITIAL_BUFFER_SIZE;
+  parser->max_read_size = MAX_HEADERS_READ_LENGTH;
+  if (parser->pool) {
+    // reinitialized parser
+    buffer_pool_unref(parser->pool, parser->buffer_class);
+    parser->pool = NULL;
+  }
+  parser->buffer_pool = Qnil;
+  parser->buffer_class = -1;
+
+  if (opts != Qnil) {
+    ID keys[6] = {ID_lazy, ID_timings, ID_min_buffer_size, ID_max_read_size, ID_buffer_pool, ID_ring_buffer};
+    VALUE values[6];
+    rb_get_kwargs(opts, keys, 0, 6, values);
+    if (values[0] != Qundef) parser->lazy = RTEST(values[0]);
+    if (values[1] != Qundef) parser->timings = RTEST(values[1]);
+    if (values[2] != Qundef) parser->min_buffer_size = NUM2INT(values[2]);
+    if (values[3] != Qundef) parser->max_read_size = NUM2INT(values[3]);
+    if (values[4] != Qundef && values[4] != Qnil) {
+      if (!rb_typeddata_is_kind_of(values[4], &BufferPool_type))
+        rb_raise(eArgumentError, "buffer_pool must be an H1P::BufferPool");
+      parser->buffer_pool = values[4];
+      GetBufferPool(parser->buffer_pool, parser->pool);
+      parser->pool->refs++;
+    }
+    if (values[5] != Qundef && RTEST(values[5])) {
+      ring_size = (values[5] == Qtrue) ? RING_BUFFER_DEFAULT_SIZE : NUM2LONG(values[5]);
+      if (ring_size < MIN_BUFFER_SIZE || ring_size > MAX_RING_BUFFER_SIZE)
+        rb_raise(eArgumentError, "ring_buffer size must be between %d and %d", MIN_BUFFER_SIZE, MAX_RING_BUFFER_SIZE);
+      if (parser->buffer_pool != Qnil)
+        rb_raise(eArgumentError, "ring_buffer cannot be used with buffer_pool");
+    }
+    if (parser->min_buffer_size < MIN_BUFFER_SIZE)
+      rb_raise(eArgumentError, "min_buffer_size must be at least %d", MIN_BUFFER_SIZE);
+    if (parser->max_read_size < parser->min_buffer_size || parser->max_read_size > MAX_BODY_READ_LENGTH)
+      rb_raise(eArgumentError, "max_read_size must be between min_buffer_size and %d", MAX_BODY_READ_LENGTH);
+  }
+  parser->read_size = parser->min_buffer_size;
 
-  // pre-allocate the buffer
-  rb_str_modify_expand(parser->buffer, INITIAL_BUFFER_SIZE);
+  // pre-allocate the buffer, or borrow it from the pool when first needed
+  if (parser->buffer_pool == Qnil)
+    rb_str_modify_expand(parser->buffer, parser->min_buffer_size);
+  else
+    parser->buffer = STR_released_buffer;
 
-  parser->read_method = detect_read_method(io);
+  parser->read_method = parser->push ? RM_CALL : detect_read_method(io);
+  if (ring_size) parser_ring_init(parser, ring_size);
   parser->body_read_mode = BODY_READ_MODE_UNKNOWN;
+  parser->framing = 0;
+  parser->content_length = -1;
   parser->body_left = 0;
+  parser->trailers = Qnil;
 
   RB_GC_GUARD(parser->io);
   RB_GC_GUARD(parser->buffer);
@@ -217,6 +674,7 @@ VALUE Parser_initialize(VALUE self, VALUE io, VALUE mode) {
 #define str_upcase(str) (rb_funcall((str), ID_upcase, 0))
 
 #define FILL_BUFFER_OR_GOTO_EOF(parser) { if (!fill_buffer(parser)) goto eof; }
+#define FILL_BODY_BUFFER_OR_GOTO_EOF(parser) { if (!fill_body_buffer(parser)) goto eof; }
 
 #define BUFFER_POS(parser) ((parser)->buf_pos)
 #define BUFFER_LEN(parser) ((parser)->buf_len)
@@ -234,60 +692,64 @@ VALUE Parser_initialize(VALUE self, VALUE io, VALUE mode) {
 
 #define INC_BUFFER_POS_NO_FILL(parser) BUFFER_POS(parser)++;
 
-#define INC_BUFFER_POS_UTF8(parser, len) { \
-  unsigned char c = BUFFER_CUR(parser); \
-  if ((c & 0xf0) == 0xf0) { \
-    while (BUFFER_LEN(parser) - BUFFER_POS(parser) < 4) FILL_BUFFER_OR_GOTO_EOF(parser); \
-    BUFFER_POS(parser) += 4; \
-    len += 4; \
-  } \
-  else if ((c & 0xe0) == 0xe0) { \
-    while (BUFFER_LEN(parser) - BUFFER_POS(parser) < 3) FILL_BUFFER_OR_GOTO_EOF(parser); \
-    BUFFER_POS(parser) += 3; \
-    len += 3; \
-  } \
-  else if ((c & 0xc0) == 0xc0) { \
-    while (BUFFER_LEN(parser) - BUFFER_POS(parser) < 2) FILL_BUFFER_OR_GOTO_EOF(parser); \
-    BUFFER_POS(parser) += 2; \
-    len += 2; \
-  } \
-  else { \
-    BUFFER_POS(parser)++; \
-    len ++; \
-    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BUFFER_OR_GOTO_EOF(parser); \
-  } \
+// Skips over bytes in the buffered region that are not delimiters according to
+// the given scanner, without going past max + 1 token bytes.
+#define SCAN_BUFFER(parser, scanner, len, max) { \
+  int avail = BUFFER_LEN(parser) - BUFFER_POS(parser); \
+  if (avail > (max) - len + 1) avail = (max) - len + 1; \
+  int skip = scanner(BUFFER_PTR(parser, BUFFER_POS(parser)), avail); \
+  BUFFER_POS(parser) += skip; \
+  len += skip; \
 }
 
 #define INIT_PARSER_STATE(parser) { \
-  (parser)->buf_len = RSTRING_LEN((parser)->buffer); \
+  if (!(parser)->ring) { \
+    (parser)->buf_len = RSTRING_LEN((parser)->buffer); \
+    (parser)->buf_ptr = RSTRING_PTR((parser)->buffer); \
+  } \
   if (BUFFER_POS(parser) == BUFFER_LEN(parser)) \
     FILL_BUFFER_OR_GOTO_EOF(parser) \
-  else \
-    (parser)->buf_ptr = RSTRING_PTR((parser)->buffer); \
+}
+
+// Sets the header to the given preallocated value and skips over the matched
+// bytes, which are already in the buffer.
+#define SET_HEADER_PREALLOCATED_VALUE(parser, key, value, len) { \
+  set_pseudo_header(parser, key, value); \
+  BUFFER_POS(parser) += len; \
+  if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BUFFER_OR_GOTO_EOF(parser); \
 }
 
 #define RAISE_BAD_REQUEST(msg) rb_raise(cError, msg)
 
+#define RAISE_PARSE_ERROR(parser, kind, msg) { \
+  STATS_ADD(parser, errors[kind], 1); \
+  RAISE_BAD_REQUEST(msg); \
+}
+
 #define SET_HEADER_VALUE_FROM_BUFFER(parser, key, pos, len) { \
-  VALUE value = BUFFER_STR(parser, pos, len); \
-  rb_hash_aset(parser->headers, key, value); \
-  RB_GC_GUARD(value); \
+  if (parser->lazy) \
+    Headers_set_pseudo_span(parser->headers, key, pos - parser->request_pos, len); \
+  else { \
+    VALUE value = BUFFER_STR(parser, pos, len); \
+    rb_hash_aset(parser->headers, key, value); \
+    RB_GC_GUARD(value); \
+  } \
 }
 
 #define SET_HEADER_DOWNCASE_VALUE_FROM_BUFFER(parser, key, pos, len) { \
   VALUE value = BUFFER_STR_DOWNCASE(parser, pos, len); \
-  rb_hash_aset(parser->headers, key, value); \
+  set_pseudo_header(parser, key, value); \
   RB_GC_GUARD(value); \
 }
 
 #define SET_HEADER_UPCASE_VALUE_FROM_BUFFER(parser, key, pos, len) { \
   VALUE value = BUFFER_STR_UPCASE(parser, pos, len); \
-  rb_hash_aset(parser->headers, key, value); \
+  set_pseudo_header(parser, key, value); \
   RB_GC_GUARD(value); \
 }
 
 #define SET_HEADER_VALUE_INT(parser, key, value) { \
-  rb_hash_aset(parser->headers, key, INT2FIX(value)); \
+  set_pseudo_header(parser, key, INT2FIX(value)); \
 }
 
 #define CONSUME_CRLF(parser) { \
@@ -312,6 +774,7 @@ VALUE Parser_initialize(VALUE self, VALUE io, VALUE mode) {
 static inline VALUE io_call(VALUE io, VALUE maxlen, VALUE buf, VALUE buf_pos) {
   VALUE result = rb_funcall(io, ID_call, 1, maxlen);
   if (result == Qnil) return Qnil;
+  if (buf == Qnil) return result;
 
   if (buf_pos == NUM_buffer_start) rb_str_set_len(buf, 0);
   rb_str_append(buf, result);
@@ -333,7 +796,234 @@ static inline VALUE io_stock_readpartial(VALUE io, VALUE maxlen, VALUE buf, VALU
   return buf;
 }
 
-static inline VALUE parser_io_read(Parser_t *parser, VALUE maxlen, VALUE buf, VALUE buf_pos) {
+#ifdef H1P_NATIVE_IO
+enum native_op {
+  OP_READ,
+  OP_WRITE,
+  OP_WRITEV,
+  OP_SPLICE,
+  OP_SENDFILE
+};
+
+typedef struct native_io_args {
+  enum native_op op;
+  int     fd;
+  int     fd_out; // splice/sendfile only
+  char    *ptr;   // read/write only (iovec array for writev)
+  size_t  len;    // iovec count for writev
+  ssize_t ret;
+  int     err;
+  off_t   *offset; // sendfile only
+} native_io_args_t;
+
+static inline ssize_t native_io_op(native_io_args_t *args) {
+  switch (args->op) {
+    case OP_READ:
+      return read(args->fd, args->ptr, args->len);
+    case OP_WRITE:
+      return write(args->fd, args->ptr, args->len);
+    case OP_WRITEV:
+      return writev(args->fd, (struct iovec *)args->ptr, args->len);
+#ifdef H1P_NATIVE_SPLICE
+    case OP_SPLICE:
+      return splice(args->fd, NULL, args->fd_out, NULL, args->len, SPLICE_F_MOVE);
+#endif
+#ifdef H1P_NATIVE_SENDFILE
+    case OP_SENDFILE:
+      return sendfile(args->fd_out, args->fd, args->offset, args->len);
+#endif
+    default:
+      errno = ENOSYS;
+      return -1;
+  }
+}
+
+static void *native_io_without_gvl(void *ptr) {
+  native_io_args_t *args = ptr;
+  args->ret = native_io_op(args);
+  args->err = errno;
+  return NULL;
+}
+
+// Performs the given I/O operation, releasing the GVL if needed. A thread
+// blocked in a system call is interrupted by RUBY_UBF_IO, in which case EINTR is
+// returned.
+static inline ssize_t native_io(native_io_args_t *args, int release_gvl) {
+  if (!release_gvl) return native_io_op(args);
+
+  rb_thread_call_without_gvl(native_io_without_gvl, args, RUBY_UBF_IO, NULL);
+  errno = args->err;
+  return args->ret;
+}
+
+typedef struct native_io_locked_args {
+  native_io_args_t *args;
+  VALUE *strs;
+  int   count;
+  unsigned int locked; // bit mask of locked strings
+} native_io_locked_args_t;
+
+// Frozen strings cannot be modified and need not be locked. A string appearing
+// more than once is locked only once.
+static inline int str_lock_needed_p(VALUE *strs, int i) {
+  if (OBJ_FROZEN(strs[i])) return 0;
+  for (int j = 0; j < i; j++)
+    if (strs[j] == strs[i]) return 0;
+  return 1;
+}
+
+static VALUE native_io_locked_body(VALUE ptr) {
+  native_io_locked_args_t *locked_args = (native_io_locked_args_t *)ptr;
+  for (int i = 0; i < locked_args->count; i++) {
+    if (!str_lock_needed_p(locked_args->strs, i)) continue;
+    rb_str_locktmp(locked_args->strs[i]);
+    locked_args->locked |= 1U << i;
+  }
+  rb_thread_call_without_gvl(native_io_without_gvl, locked_args->args, RUBY_UBF_IO, NULL);
+  return Qnil;
+}
+
+static VALUE native_io_locked_ensure(VALUE ptr) {
+  native_io_locked_args_t *locked_args = (native_io_locked_args_t *)ptr;
+  for (int i = 0; i < locked_args->count; i++)
+    if (locked_args->locked & (1U << i)) rb_str_unlocktmp(locked_args->strs[i]);
+  return Qnil;
+}
+
+// Performs the given I/O operation with the GVL released, as native_io does,
+// while the given strings, whose memory is used by the operation, are locked.
+// This prevents other threads from modifying or freeing them in the meantime.
+static ssize_t native_io_locked(native_io_args_t *args, VALUE *strs, int count) {
+  native_io_locked_args_t locked_args = {args, strs, count, 0};
+  rb_ensure(native_io_locked_body, (VALUE)&locked_args, native_io_locked_ensure, (VALUE)&locked_args);
+  errno = args->err;
+  return args->ret;
+}
+
+static inline ssize_t native_read(int fd, char *ptr, size_t len, int release_gvl) {
+  native_io_args_t args = {OP_READ, fd, -1, ptr, len, 0, 0};
+  return native_io(&args, release_gvl);
+}
+
+// Writes all of the given data to the IO's fd. Non-blocking fds are waited on
+// for writability, blocking fds are written to with the GVL released.
+static void io_native_write(VALUE io, int blocking, char *ptr, long len) {
+  int fd = rb_io_descriptor(io);
+
+  while (len > 0) {
+    native_io_args_t args = {OP_WRITE, fd, -1, ptr, len, 0, 0};
+    ssize_t n = native_io(&args, blocking);
+    if (n >= 0) {
+      ptr += n;
+      len -= n;
+      continue;
+    }
+    int e = errno;
+    if (!rb_io_maybe_wait_writable(e, io, Qnil)) rb_syserr_fail(e, "write");
+  }
+}
+
+// Replaces the given strings with frozen copies, which share their memory with
+// the originals, pointing the iovecs referring to them to the copies. Like
+// IO#write, this makes sure the written data stays valid if a string is
+// modified by another thread or fiber while waiting for the fd.
+static inline void iov_freeze_strs(struct iovec *iov, int iovcnt, VALUE *strs, int str_count) {
+  for (int i = 0; i < str_count; i++) {
+    if (OBJ_FROZEN(strs[i])) continue;
+
+    char *ptr = RSTRING_PTR(strs[i]);
+    long len = RSTRING_LEN(strs[i]);
+    strs[i] = rb_str_new_frozen(strs[i]);
+    char *frozen_ptr = RSTRING_PTR(strs[i]);
+    if (frozen_ptr == ptr) continue;
+
+    for (int j = 0; j < iovcnt; j++) {
+      char *base = iov[j].iov_base;
+      if (base >= ptr && base < ptr + len) iov[j].iov_base = frozen_ptr + (base - ptr);
+    }
+  }
+}
+
+// Writes all of the given buffers to the IO's fd using writev(2), looping on
+// short writes. The iovec array is modified. Returns the number of bytes
+// written. The given strings holding the buffers are replaced with frozen
+// copies (see iov_freeze_strs) for the duration of the write, since the GVL
+// may be released, or the thread may wait for the fd to become writable.
+static size_t io_native_writev(VALUE io, int blocking, struct iovec *iov, int iovcnt, VALUE *strs, int str_count) {
+  int fd = rb_io_descriptor(io);
+  size_t total = 0;
+
+  iov_freeze_strs(iov, iovcnt, strs, str_count);
+  while (iovcnt > 0) {
+    native_io_args_t args = {OP_WRITEV, fd, -1, (char *)iov, iovcnt, 0, 0};
+    ssize_t n = native_io(&args, blocking);
+    if (n < 0) {
+      int e = errno;
+      if (!rb_io_maybe_wait_writable(e, io, Qnil)) rb_syserr_fail(e, "writev");
+      continue;
+    }
+    total += n;
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return total;
+}
+
+static inline int fiber_scheduler_p(void) {
+#ifdef HAVE_RB_FIBER_SCHEDULER_CURRENT
+  return rb_fiber_scheduler_current() != Qnil;
+#else
+  return 0;
+#endif
+}
+
+// Reads up to maxlen bytes directly into buf (or into a new string if buf is
+// nil), avoiding the intermediate string allocated by IO#readpartial. If the
+// IO has data in its internal buffer (e.g. from a previous call to IO#gets) the
+// read is done using IO#readpartial. The GVL is released for blocking fds, and
+// for large reads from non-blocking fds (once the fd is readable).
+static inline VALUE io_native_read(VALUE io, int blocking, VALUE maxlen, VALUE buf, VALUE buf_pos) {
+  rb_io_t *fptr;
+  RB_IO_POINTER(io, fptr);
+  if (rb_io_read_pending(fptr) || (blocking && fiber_scheduler_p()))
+    return io_stock_readpartial(io, maxlen, buf, buf_pos);
+
+  int fd = rb_io_descriptor(io);
+  int len = FIX2INT(maxlen);
+  if (buf == Qnil) {
+    buf = rb_str_buf_new(len);
+    buf_pos = NUM_buffer_start;
+  }
+  if (buf_pos == NUM_buffer_start) rb_str_set_len(buf, 0);
+  long pos = RSTRING_LEN(buf);
+  rb_str_modify_expand(buf, len);
+  int release_gvl = blocking || len >= NOGVL_READ_MIN_LENGTH;
+
+  while (1) {
+    // buf may be owned by the caller (e.g. with #read_body_into), so it is
+    // locked while the GVL is released
+    native_io_args_t args = {OP_READ, fd, -1, RSTRING_PTR(buf) + pos, len, 0, 0};
+    ssize_t n = release_gvl ? native_io_locked(&args, &buf, 1) : native_io(&args, 0);
+    if (n > 0) {
+      rb_str_set_len(buf, pos + n);
+      return buf;
+    }
+    if (n == 0) return Qnil;
+
+    int e = errno;
+    if (!rb_io_maybe_wait_readable(e, io, Qnil)) rb_syserr_fail(e, "read");
+  }
+}
+#endif
+
+static inline VALUE parser_io_read_method(Parser_t *parser, VALUE maxlen, VALUE buf, VALUE buf_pos) {
   switch (parser->read_method) {
     case RM_BACKEND_READ:
       return rb_funcall(Polyphony(), ID_backend_read, 5, parser->io, buf, maxlen, Qfalse, buf_pos);
@@ -345,30 +1035,264 @@ static inline VALUE parser_io_read(Parser_t *parser, VALUE maxlen, VALUE buf, VA
       return io_call(parser->io, maxlen, buf, buf_pos);
     case RM_STOCK_READPARTIAL:
       return io_stock_readpartial(parser->io, maxlen, buf, buf_pos);
+#ifdef H1P_NATIVE_IO
+    case RM_NATIVE:
+      return io_native_read(parser->io, 0, maxlen, buf, buf_pos);
+    case RM_NATIVE_BLOCKING:
+      return io_native_read(parser->io, 1, maxlen, buf, buf_pos);
+#endif
     default:
       return Qnil;
   }
 }
 
-static inline VALUE parser_io_write(VALUE io, VALUE buf, enum write_method method) {
+// Reads from the parser's IO. If buf is given, data is appended to it.
+static inline VALUE parser_io_read(Parser_t *parser, VALUE maxlen, VALUE buf, VALUE buf_pos) {
+  long len = (buf == Qnil) ? 0 : RSTRING_LEN(buf);
+  VALUE ret = parser_io_read_method(parser, maxlen, buf, buf_pos);
+  STATS_ADD(parser, reads, 1);
+  if (ret != Qnil) STATS_ADD(parser, bytes_read, RSTRING_LEN(ret) - len);
+  return ret;
+}
+
+// Writes len bytes at ptr to the given IO.
+static inline void parser_io_write(VALUE io, char *ptr, int len, enum write_method method) {
+  VALUE buf;
   switch (method) {
     case WM_BACKEND_WRITE:
-      return rb_funcall(Polyphony(), ID_backend_write, 2, io, buf);
+      buf = rb_str_new(ptr, len);
+      rb_funcall(Polyphony(), ID_backend_write, 2, io, buf);
+      RB_GC_GUARD(buf);
+      return;
     case WM_BACKEND_SEND:
-      return rb_funcall(Polyphony(), ID_backend_send, 3, io, buf, INT2FIX(0));
+      buf = rb_str_new(ptr, len);
+      rb_funcall(Polyphony(), ID_backend_send, 3, io, buf, INT2FIX(0));
+      RB_GC_GUARD(buf);
+      return;
+#ifdef H1P_NATIVE_IO
+    case WM_NATIVE:
+    case WM_NATIVE_BLOCKING:
+      io_native_write(io, method == WM_NATIVE_BLOCKING, ptr, len);
+      return;
+#endif
     default:
-      return Qnil;
+      return;
+  }
+}
+
+#ifdef H1P_NATIVE_SPLICE
+typedef struct splice_drain_args {
+  Parser_t  *parser;
+  VALUE     dest;
+  ssize_t   left;
+  int       blocking;
+} splice_drain_args_t;
+
+// Moves the data in the internal pipe to dest.
+static VALUE splice_pipe_drain(VALUE ptr) {
+  splice_drain_args_t *args = (splice_drain_args_t *)ptr;
+  int dest_fd = rb_io_descriptor(args->dest);
+
+  while (args->left > 0) {
+    native_io_args_t io_args = {OP_SPLICE, args->parser->splice_pipe[0], dest_fd, NULL, args->left, 0, 0};
+    ssize_t m = native_io(&io_args, args->blocking);
+    if (m >= 0) {
+      args->left -= m;
+      continue;
+    }
+    int e = errno;
+    if (!rb_io_maybe_wait_writable(e, args->dest, Qnil)) rb_syserr_fail(e, "splice");
+  }
+  return Qnil;
+}
+
+// Moves up to len bytes from the parser's IO to dest through the internal pipe,
+// returning the number of bytes moved, or 0 on EOF. For non-blocking sources,
+// the source is spliced with SPLICE_F_NONBLOCK, the reading thread waiting for
+// readiness through rb_io_maybe_wait_readable. Since SPLICE_F_NONBLOCK does not
+// apply to blocking sockets, blocking sources are spliced with the GVL released.
+static int io_native_splice(Parser_t *parser, VALUE dest, int64_t len, enum write_method method) {
+  if (parser->splice_pipe[0] == -1 && pipe2(parser->splice_pipe, O_NONBLOCK | O_CLOEXEC))
+    rb_sys_fail("pipe2");
+
+  int src_fd = rb_io_descriptor(parser->io);
+  int blocking_src = parser->read_method == RM_NATIVE_BLOCKING;
+  if (len > SPLICE_CHUNK_SIZE) len = SPLICE_CHUNK_SIZE;
+
+  ssize_t n;
+  while (1) {
+    if (blocking_src) {
+      native_io_args_t args = {OP_SPLICE, src_fd, parser->splice_pipe[1], NULL, len, 0, 0};
+      n = native_io(&args, 1);
+    }
+    else
+      n = splice(src_fd, NULL, parser->splice_pipe[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n >= 0) break;
+    int e = errno;
+    if (!rb_io_maybe_wait_readable(e, parser->io, Qnil)) rb_syserr_fail(e, "splice");
+  }
+
+  splice_drain_args_t drain_args = {parser, dest, n, method == WM_NATIVE_BLOCKING};
+  int state = 0;
+  rb_protect(splice_pipe_drain, (VALUE)&drain_args, &state);
+  if (state) {
+    // Data left in the pipe would otherwise be sent to the next destination
+    splice_pipe_close(parser);
+    rb_jump_tag(state);
+  }
+  return n;
+}
+#endif
+
+// Moves up to len bytes of body data from the parser's IO to dest, returning
+// the number of bytes moved, or 0 on EOF. For native IO destinations, the data
+// is spliced if the parser's IO is also native (on Linux), otherwise it is read
+// and then written.
+static inline int parser_io_splice(Parser_t *parser, VALUE dest, int64_t len, enum write_method method) {
+  if (len > MAX_BODY_READ_LENGTH) len = MAX_BODY_READ_LENGTH;
+  if (method == WM_BACKEND_WRITE || method == WM_BACKEND_SEND) {
+    VALUE ret = rb_funcall(Polyphony(), ID_backend_splice, 3, parser->io, dest, INT2FIX(len));
+    return FIX2INT(ret);
+  }
+
+#ifdef H1P_NATIVE_SPLICE
+  if (parser->read_method == RM_NATIVE || parser->read_method == RM_NATIVE_BLOCKING) {
+    rb_io_t *fptr;
+    RB_IO_POINTER(parser->io, fptr);
+    if (!rb_io_read_pending(fptr)) return io_native_splice(parser, dest, len, method);
+  }
+#endif
+
+  VALUE buf = parser_io_read(parser, INT2FIX(len), Qnil, NUM_buffer_start);
+  if (buf == Qnil) return 0;
+
+  int read_bytes = RSTRING_LEN(buf);
+  parser_io_write(dest, RSTRING_PTR(buf), read_bytes, method);
+  RB_GC_GUARD(buf);
+  return read_bytes;
+}
+
+// Borrows a buffer from the parser's buffer pool, if the parser's buffer was
+// released. For native IO, the borrowing is deferred until the IO is readable,
+// so parsers waiting on idle connections hold no buffer.
+static inline void parser_buffer_acquire(Parser_t *parser, int size) {
+  if (parser->buffer != STR_released_buffer) return;
+
+#ifdef H1P_NATIVE_IO
+  if (!parser->push && (parser->read_method == RM_NATIVE || parser->read_method == RM_NATIVE_BLOCKING)) {
+    rb_io_t *fptr;
+    RB_IO_POINTER(parser->io, fptr);
+    if (!rb_io_read_pending(fptr)) rb_io_maybe_wait_readable(EAGAIN, parser->io, Qnil);
+  }
+#endif
+
+  parser->buffer = BufferPool_get(parser->buffer_pool, size, &parser->buffer_class);
+  parser->buf_ptr = RSTRING_PTR(parser->buffer);
+  parser->buf_len = 0;
+}
+
+// Returns the parser's buffer to its buffer pool, if the buffer was consumed up
+// to the given position.
+static inline void parser_buffer_release(Parser_t *parser, int pos) {
+  if (parser->buffer_pool == Qnil || parser->buffer == STR_released_buffer) return;
+  if (pos < RSTRING_LEN(parser->buffer)) return;
+
+  BufferPool_put(parser->buffer_pool, parser->buffer, parser->buffer_class);
+  parser->buffer = STR_released_buffer;
+  parser->buffer_class = -1;
+  parser->buf_ptr = RSTRING_PTR(parser->buffer);
+  parser->buf_len = parser->buf_pos = parser->request_pos = parser->scan_pos = 0;
+}
+
+#ifdef H1P_RING_BUFFER
+// Replaces a full ring buffer with one twice the size.
+static void ring_grow(Parser_t *parser) {
+  size_t size = parser->ring_size * 2;
+  if (size > MAX_RING_BUFFER_SIZE) RAISE_BAD_REQUEST("Message too large");
+  char *ring = ring_map(&size);
+  if (!ring) rb_sys_fail("ring_map");
+
+  memcpy(ring, parser->buf_ptr, parser->buf_len);
+  ring_unmap(parser->ring, parser->ring_size);
+  parser->ring = ring;
+  parser->ring_size = size;
+  parser->ring_head = 0;
+  parser->buf_ptr = ring;
+  STATS_MAX(parser, buffer_high_water, size);
+}
+
+// Reads from the parser's (native) IO into the free space of the ring buffer.
+static int ring_fill(Parser_t *parser) {
+  if ((size_t)parser->buf_len == parser->ring_size) ring_grow(parser);
+
+  int len = parser->ring_size - parser->buf_len;
+  if (len > parser->read_size) len = parser->read_size;
+  char *ptr = parser->buf_ptr + parser->buf_len;
+  int blocking = parser->read_method == RM_NATIVE_BLOCKING;
+  ssize_t n;
+
+  rb_io_t *fptr;
+  RB_IO_POINTER(parser->io, fptr);
+  if (rb_io_read_pending(fptr) || (blocking && fiber_scheduler_p())) {
+    VALUE str = io_stock_readpartial(parser->io, INT2FIX(len), Qnil, NUM_buffer_start);
+    if (str == Qnil) return 0;
+    n = RSTRING_LEN(str);
+    memcpy(ptr, RSTRING_PTR(str), n);
+    RB_GC_GUARD(str);
   }
+  else {
+    int fd = rb_io_descriptor(parser->io);
+    while (1) {
+      n = native_read(fd, ptr, len, blocking || len >= NOGVL_READ_MIN_LENGTH);
+      if (n > 0) break;
+      if (n == 0) return 0;
+
+      int e = errno;
+      if (!rb_io_maybe_wait_readable(e, parser->io, Qnil)) rb_syserr_fail(e, "read");
+    }
+  }
+
+  parser->buf_len += n;
+  STATS_ADD(parser, reads, 1);
+  STATS_ADD(parser, bytes_read, n);
+  STATS_ADD(parser, buffer_refills, 1);
+  timings_data_received(parser);
+  return n;
 }
 
-static inline int parser_io_splice(VALUE src, VALUE dest, int len) {
-  VALUE ret = rb_funcall(Polyphony(), ID_backend_splice, 3, src, dest, INT2FIX(len));
-  return FIX2INT(ret);
+// Discards consumed data by advancing the head of the ring buffer.
+static inline void ring_trim(Parser_t *parser) {
+  parser->ring_head += parser->buf_pos;
+  if (parser->ring_head >= parser->ring_size) parser->ring_head -= parser->ring_size;
+  parser->buf_len -= parser->buf_pos;
+  parser->request_pos -= parser->buf_pos;
+  parser->buf_pos = 0;
+  parser->buf_ptr = parser->ring + parser->ring_head;
 }
+#endif
 
 static inline int fill_buffer(Parser_t *parser) {
-  VALUE ret = parser_io_read(parser, NUM_max_headers_read_length, parser->buffer, NUM_buffer_end);
+  if (parser->buffered_only) return 0;
+
+  // Grow the read size if the current message doesn't fit in a single read
+  if (parser->buf_len - parser->request_pos >= parser->read_size && parser->read_size < parser->max_read_size) {
+    parser->read_size *= 2;
+    if (parser->read_size > parser->max_read_size) parser->read_size = parser->max_read_size;
+  }
+
+#ifdef H1P_RING_BUFFER
+  if (parser->ring) return ring_fill(parser);
+#endif
+
+  parser_buffer_acquire(parser, parser->read_size);
+
+  VALUE ret = parser_io_read(parser, INT2FIX(parser->read_size), parser->buffer, NUM_buffer_end);
   if (ret == Qnil) return 0;
+  if (ret != parser->buffer && parser->buffer_class >= 0) {
+    // the read method returned a different string, return the borrowed buffer
+    BufferPool_put(parser->buffer_pool, parser->buffer, parser->buffer_class);
+    parser->buffer_class = -1;
+  }
 
   parser->buffer = ret;
   int len = RSTRING_LEN(parser->buffer);
@@ -377,97 +1301,544 @@ static inline int fill_buffer(Parser_t *parser) {
 
   parser->buf_ptr = RSTRING_PTR(parser->buffer);
   parser->buf_len = len;
+  STATS_ADD(parser, buffer_refills, 1);
+  STATS_MAX(parser, buffer_high_water, rb_str_capacity(parser->buffer));
+  timings_data_received(parser);
   return read_bytes;
 }
 
-static inline void buffer_trim(Parser_t *parser) {
+// Shrinks an empty buffer back to the current read size, if its capacity is
+// more than twice that, e.g. after being grown by a message with large headers.
+// Since the read size decays back to min_buffer_size when messages are small,
+// idle connections end up holding a small buffer, while buffers sized for a
+// stream of large messages are not repeatedly shrunk and grown.
+static inline void buffer_shrink(Parser_t *parser) {
+  if (rb_str_capacity(parser->buffer) <= (size_t)parser->read_size * 2) return;
+
+  rb_str_resize(parser->buffer, parser->read_size);
+  rb_str_set_len(parser->buffer, 0);
+  parser->buf_ptr = RSTRING_PTR(parser->buffer);
+  parser->buf_len = 0;
+}
+
+// Discards consumed data from the buffer. A fully consumed buffer is always
+// emptied (which involves no copying), and is also shrunk if shrink is set.
+// Buffer offsets, including the start of the current message, are rebased.
+static inline void buffer_discard(Parser_t *parser, int shrink) {
+#ifdef H1P_RING_BUFFER
+  if (parser->ring) {
+    ring_trim(parser);
+    return;
+  }
+#endif
+
   int len = RSTRING_LEN(parser->buffer);
   int pos = parser->buf_pos;
   int left = len - pos;
-
-  // The buffer is trimmed only if length and position thresholds are passed,
-  // *and* position is past the halfway point.
-  if (len < BUFFER_TRIM_MIN_LEN ||
-      pos < BUFFER_TRIM_MIN_POS ||
-      left >= pos) return;
+  if (!pos) return;
 
   if (left > 0) {
+    // Remaining data is moved only if length and position thresholds are
+    // passed, *and* position is past the halfway point.
+    if (len < BUFFER_TRIM_MIN_LEN ||
+        pos < BUFFER_TRIM_MIN_POS ||
+        left >= pos) return;
+
     char *ptr = RSTRING_PTR(parser->buffer);
-    memcpy(ptr, ptr + pos, left);
+    memmove(ptr, ptr + pos, left);
+    STATS_ADD(parser, buffer_trims, 1);
+    STATS_ADD(parser, buffer_bytes_moved, left);
   }
   rb_str_set_len(parser->buffer, left);
   parser->buf_pos = 0;
+  parser->buf_len = left;
+  parser->request_pos -= pos;
+  if (!left && shrink) buffer_shrink(parser);
+}
+
+static inline void buffer_trim(Parser_t *parser) {
+  buffer_discard(parser, 1);
+}
+
+// Fills the buffer while reading a chunked body, first discarding consumed
+// data, so that the buffer (or ring buffer) does not grow with the body size.
+// The buffer is not shrunk, since it is about to be filled again.
+static inline int fill_body_buffer(Parser_t *parser) {
+  buffer_discard(parser, 0);
+  return fill_buffer(parser);
+}
+
+// Returns a frozen lowercase key for the given header name, which is assumed to
+// consist of valid token characters. Well-known names are looked up in a
+// perfect hash table, other names are interned, so that repeated names across
+// requests share the same string.
+static inline VALUE header_key_str(const char *ptr, int len) {
+  #define LC(i) token_lower[(unsigned char)ptr[i]]
+
+  if (len >= 2) {
+    int slot = header_name_slots[HEADER_NAME_HASH(LC(0), LC(len / 2), LC(len - 2), LC(len - 1), len)];
+    if (slot && header_names[slot - 1].len == len) {
+      const char *name = header_names[slot - 1].name;
+      int i = 0;
+      while (i < len && LC(i) == (unsigned char)name[i]) i++;
+      if (i == len) return header_name_strs[slot - 1];
+    }
+  }
+
+  char lower[MAX_HEADER_KEY_LENGTH];
+  for (int i = 0; i < len; i++) lower[i] = LC(i);
+  return rb_enc_interned_str(lower, len, enc_utf8);
+
+  #undef LC
+}
+
+// Makes room for len more bytes in the given string.
+static inline void str_reserve(VALUE str, long len) {
+  long str_len = RSTRING_LEN(str);
+  // rb_str_modify_expand sets the capacity to exactly the needed size (which may
+  // shrink the string), so it is used only when growing, by at least 2x.
+  if (rb_str_capacity(str) < (size_t)(str_len + len))
+    rb_str_modify_expand(str, len > str_len ? len : str_len);
+  else
+    rb_str_modify(str);
 }
 
-static inline void str_append_from_buffer(VALUE str, char *ptr, int len) {
-  int str_len = RSTRING_LEN(str);
-  rb_str_modify_expand(str, len);
+static inline void str_append_from_buffer(VALUE str, char *ptr, long len) {
+  long str_len = RSTRING_LEN(str);
+  str_reserve(str, len);
   memcpy(RSTRING_PTR(str) + str_len, ptr, len);
   rb_str_set_len(str, str_len + len);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+// Lazy headers
+
+enum pseudo_header {
+  PSEUDO_METHOD,
+  PSEUDO_PATH,
+  PSEUDO_PROTOCOL,
+  PSEUDO_STATUS,
+  PSEUDO_STATUS_MESSAGE,
+  PSEUDO_COUNT
+};
 
-static inline int parse_request_line_method(Parser_t *parser) {
-  int pos = BUFFER_POS(parser);
-  int len = 0;
+// A value recorded as an offset and length into the header block. The value
+// string is created on first access.
+typedef struct lazy_value {
+  int   pos;
+  int   len;
+  VALUE value; // Qundef if not yet created
+} lazy_value_t;
 
-  while (1) {
-    switch (BUFFER_CUR(parser)) {
-      case ' ':
-        if (len < 1 || len > MAX_METHOD_LENGTH) goto bad_request;
-        INC_BUFFER_POS(parser);
-        goto done;
-      case '\r':
-      case '\n':
-        goto bad_request;
-      default:
-        INC_BUFFER_POS(parser);
-        len++;
-        // INC_BUFFER_POS_UTF8(parser, len);
-        if (len > MAX_METHOD_LENGTH) goto bad_request;
-    }
-  }
-done:
-  SET_HEADER_UPCASE_VALUE_FROM_BUFFER(parser, STR_pseudo_method, pos, len);
-  return 1;
-bad_request:
-  RAISE_BAD_REQUEST("Invalid method");
-eof:
-  return 0;
+typedef struct lazy_header {
+  int           key_pos;
+  int           key_len;
+  lazy_value_t  value;
+} lazy_header_t;
+
+#define HEADERS_INLINE_ENTRIES 16
+
+typedef struct headers {
+  enum  parser_mode mode;
+  VALUE block;    // frozen copy of the header block
+  VALUE overlay;  // hash of values set using #[]=
+  int64_t rx;
+
+  lazy_value_t pseudo[PSEUDO_COUNT];
+
+  int            count;
+  int            capa;
+  lazy_header_t *entries;
+  lazy_header_t  inline_entries[HEADERS_INLINE_ENTRIES];
+} Headers_t;
+
+static void Headers_mark(void *ptr) {
+  Headers_t *headers = ptr;
+  // the block is pinned, since the struct only holds offsets into it
+  rb_gc_mark(headers->block);
+  rb_gc_mark(headers->overlay);
+  for (int i = 0; i < PSEUDO_COUNT; i++)
+    if (headers->pseudo[i].value != Qundef) rb_gc_mark(headers->pseudo[i].value);
+  for (int i = 0; i < headers->count; i++)
+    if (headers->entries[i].value.value != Qundef) rb_gc_mark(headers->entries[i].value.value);
 }
 
-static int parse_request_line_target(Parser_t *parser) {
-  while (BUFFER_CUR(parser) == ' ') INC_BUFFER_POS(parser);
-  int pos = BUFFER_POS(parser);
-  int len = 0;
-  while (1) {
-    switch (BUFFER_CUR(parser)) {
-      case ' ':
-        if (len < 1 || len > MAX_PATH_LENGTH) goto bad_request;
-        INC_BUFFER_POS(parser);
-        goto done;
-      case '\r':
-      case '\n':
-        goto bad_request;
-      default:
-        INC_BUFFER_POS(parser);
-        len++;
-        // INC_BUFFER_POS_UTF8(parser, len);
-        if (len > MAX_PATH_LENGTH) goto bad_request;
-    }
-  }
-done:
-  SET_HEADER_VALUE_FROM_BUFFER(parser, STR_pseudo_path, pos, len);
-  return 1;
-bad_request:
-  RAISE_BAD_REQUEST("Invalid request target");
-eof:
-  return 0;
+static void Headers_free(void *ptr) {
+  Headers_t *headers = ptr;
+  if (headers->entries != headers->inline_entries) xfree(headers->entries);
+  xfree(ptr);
+}
+
+static size_t Headers_size(const void *ptr) {
+  const Headers_t *headers = ptr;
+  size_t size = sizeof(Headers_t);
+  if (headers->entries != headers->inline_entries)
+    size += headers->capa * sizeof(lazy_header_t);
+  return size;
+}
+
+static const rb_data_type_t Headers_type = {
+  "Headers",
+  {Headers_mark, Headers_free, Headers_size,},
+  0, 0, 0
+};
+
+#define GetHeaders(obj, headers) \
+  TypedData_Get_Struct((obj), Headers_t, &Headers_type, (headers))
+
+static VALUE Headers_new(enum parser_mode mode) {
+  Headers_t *headers;
+  VALUE obj = TypedData_Make_Struct(cHeaders, Headers_t, &Headers_type, headers);
+
+  headers->mode = mode;
+  headers->block = Qnil;
+  headers->overlay = Qnil;
+  headers->rx = 0;
+  for (int i = 0; i < PSEUDO_COUNT; i++)
+    headers->pseudo[i] = (lazy_value_t){-1, -1, Qundef};
+  headers->count = 0;
+  headers->capa = HEADERS_INLINE_ENTRIES;
+  headers->entries = headers->inline_entries;
+  return obj;
+}
+
+static inline int pseudo_header_idx(VALUE key) {
+  if (key == STR_pseudo_method)         return PSEUDO_METHOD;
+  if (key == STR_pseudo_path)           return PSEUDO_PATH;
+  if (key == STR_pseudo_protocol)       return PSEUDO_PROTOCOL;
+  if (key == STR_pseudo_status)         return PSEUDO_STATUS;
+  return PSEUDO_STATUS_MESSAGE;
+}
+
+static inline void Headers_set_pseudo_span(VALUE self, VALUE key, int pos, int len) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+  headers->pseudo[pseudo_header_idx(key)] = (lazy_value_t){pos, len, Qundef};
+}
+
+static inline void Headers_set_pseudo_value(VALUE self, VALUE key, VALUE value) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+  RB_OBJ_WRITE(self, &headers->pseudo[pseudo_header_idx(key)].value, value);
+  headers->pseudo[pseudo_header_idx(key)].len = 0;
+}
+
+static inline void Headers_add(VALUE self, int key_pos, int key_len, int pos, int len) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+
+  if (headers->count == headers->capa) {
+    int capa = headers->capa * 2;
+    if (headers->entries == headers->inline_entries) {
+      headers->entries = ALLOC_N(lazy_header_t, capa);
+      memcpy(headers->entries, headers->inline_entries, sizeof(headers->inline_entries));
+    }
+    else
+      REALLOC_N(headers->entries, lazy_header_t, capa);
+    headers->capa = capa;
+  }
+  headers->entries[headers->count++] = (lazy_header_t){key_pos, key_len, {pos, len, Qundef}};
+}
+
+static inline void Headers_set_block(VALUE self, const char *ptr, int len) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+  RB_OBJ_WRITE(self, &headers->block, rb_obj_freeze(rb_str_new(ptr, len)));
+}
+
+static inline void Headers_set_rx(VALUE self, int64_t rx) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+  headers->rx = rx;
+}
+
+static inline VALUE Headers_value(VALUE self, Headers_t *headers, lazy_value_t *value) {
+  if (value->value == Qundef) {
+    VALUE str = rb_obj_freeze(rb_utf8_str_new(RSTRING_PTR(headers->block) + value->pos, value->len));
+    RB_OBJ_WRITE(self, &value->value, str);
+  }
+  return value->value;
+}
+
+static VALUE Headers_pseudo_aref(VALUE self, Headers_t *headers, const char *ptr, long len) {
+  int idx;
+
+  #define PSEUDO_KEY_P(key) (len == (long)sizeof(key) - 1 && !memcmp(ptr, key, len))
+  if (PSEUDO_KEY_P(":rx"))                  return LL2NUM(headers->rx);
+  else if (PSEUDO_KEY_P(":method"))         idx = PSEUDO_METHOD;
+  else if (PSEUDO_KEY_P(":path"))           idx = PSEUDO_PATH;
+  else if (PSEUDO_KEY_P(":protocol"))       idx = PSEUDO_PROTOCOL;
+  else if (PSEUDO_KEY_P(":status"))         idx = PSEUDO_STATUS;
+  else if (PSEUDO_KEY_P(":status_message")) idx = PSEUDO_STATUS_MESSAGE;
+  else return Qnil;
+  #undef PSEUDO_KEY_P
+
+  if (headers->pseudo[idx].len < 0) return Qnil;
+  return Headers_value(self, headers, &headers->pseudo[idx]);
+}
+
+static inline int Headers_key_match(Headers_t *headers, lazy_header_t *entry, const char *ptr, long len) {
+  if (entry->key_len != len) return 0;
+
+  const unsigned char *key = (const unsigned char *)RSTRING_PTR(headers->block) + entry->key_pos;
+  for (long i = 0; i < len; i++)
+    if (token_lower[key[i]] != (unsigned char)ptr[i]) return 0;
+  return 1;
+}
+
+static VALUE Headers_header_aref(VALUE self, Headers_t *headers, const char *ptr, long len) {
+  VALUE result = Qnil;
+  for (int i = 0; i < headers->count; i++) {
+    lazy_header_t *entry = headers->entries + i;
+    if (!Headers_key_match(headers, entry, ptr, len)) continue;
+
+    VALUE value = Headers_value(self, headers, &entry->value);
+    if (result == Qnil)
+      result = value;
+    else if (TYPE(result) != T_ARRAY)
+      result = rb_ary_new3(2, result, value);
+    else
+      rb_ary_push(result, value);
+  }
+  return result;
+}
+
+/* call-seq: headers[key] -> value
+ *
+ * Returns the value for the given header key. Header values are converted to
+ * strings on first access.
+ */
+VALUE Headers_aref(VALUE self, VALUE key) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+
+  if (headers->overlay != Qnil) {
+    VALUE value = rb_hash_lookup2(headers->overlay, key, Qundef);
+    if (value != Qundef) return value;
+  }
+  if (TYPE(key) != T_STRING) return Qnil;
+
+  const char *ptr = RSTRING_PTR(key);
+  long len = RSTRING_LEN(key);
+  if (len && ptr[0] == ':')
+    return Headers_pseudo_aref(self, headers, ptr, len);
+  else
+    return Headers_header_aref(self, headers, ptr, len);
+}
+
+/* call-seq: headers[key] = value
+ *
+ * Sets the value for the given header key.
+ */
+VALUE Headers_aset(VALUE self, VALUE key, VALUE value) {
+  Headers_t *headers;
+  GetHeaders(self, headers);
+
+  if (headers->overlay == Qnil) RB_OBJ_WRITE(self, &headers->overlay, rb_hash_new());
+  rb_hash_aset(headers->overlay, key, value);
+  return value;
+}
+
+/* call-seq: headers.key?(key) -> bool
+ *
+ * Returns true if the given header key is present.
+ */
+VALUE Headers_key_p(VALUE self, VALUE key) {
+  return Headers_aref(self, key) == Qnil ? Qfalse : Qtrue;
+}
+
+static inline void hash_add_header(VALUE hash, VALUE key, VALUE value) {
+  VALUE existing = rb_hash_aref(hash, key);
+  if (existing != Qnil) {
+    if (TYPE(existing) != T_ARRAY) {
+      existing = rb_ary_new3(2, existing, value);
+      rb_hash_aset(hash, key, existing);
+    }
+    else
+      rb_ary_push(existing, value);
+  }
+  else
+    rb_hash_aset(hash, key, value);
+
+  RB_GC_GUARD(existing);
+}
+
+static int Headers_to_h_update(VALUE key, VALUE value, VALUE hash) {
+  rb_hash_aset(hash, key, value);
+  return ST_CONTINUE;
+}
+
+/* call-seq: headers.to_h -> hash
+ *
+ * Returns a hash containing all headers, identical to the hash returned by
+ * `Parser#parse_headers` in non-lazy mode.
+ */
+VALUE Headers_to_h(VALUE self) {
+  static const int server_pseudo[] = {PSEUDO_METHOD, PSEUDO_PATH, PSEUDO_PROTOCOL};
+  static const int client_pseudo[] = {PSEUDO_PROTOCOL, PSEUDO_STATUS, PSEUDO_STATUS_MESSAGE};
+  static const VALUE *pseudo_keys[] = {
+    &STR_pseudo_method, &STR_pseudo_path, &STR_pseudo_protocol, &STR_pseudo_status,
+    &STR_pseudo_status_message
+  };
+  Headers_t *headers;
+  GetHeaders(self, headers);
+
+  VALUE hash = rb_hash_new();
+  const int *pseudo = headers->mode == mode_server ? server_pseudo : client_pseudo;
+  for (int i = 0; i < 3; i++) {
+    lazy_value_t *value = &headers->pseudo[pseudo[i]];
+    if (value->len >= 0)
+      rb_hash_aset(hash, *pseudo_keys[pseudo[i]], Headers_value(self, headers, value));
+  }
+
+  for (int i = 0; i < headers->count; i++) {
+    lazy_header_t *entry = headers->entries + i;
+    VALUE key = header_key_str(RSTRING_PTR(headers->block) + entry->key_pos, entry->key_len);
+    hash_add_header(hash, key, Headers_value(self, headers, &entry->value));
+  }
+  rb_hash_aset(hash, STR_pseudo_rx, LL2NUM(headers->rx));
+
+  if (headers->overlay != Qnil)
+    rb_hash_foreach(headers->overlay, Headers_to_h_update, hash);
+
+  RB_GC_GUARD(hash);
+  return hash;
+}
+
+static inline void set_pseudo_header(Parser_t *parser, VALUE key, VALUE value) {
+  if (parser->lazy)
+    Headers_set_pseudo_value(parser->headers, key, value);
+  else
+    rb_hash_aset(parser->headers, key, value);
+}
+
+static inline void set_rx(Parser_t *parser, int64_t rx) {
+  if (parser->lazy)
+    Headers_set_rx(parser->headers, rx);
+  else
+    rb_hash_aset(parser->headers, STR_pseudo_rx, LL2NUM(rx));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static inline uint32_t load32(const char *ptr) {
+  uint32_t v;
+  memcpy(&v, ptr, 4);
+  return v;
+}
+
+static inline uint64_t load64(const char *ptr) {
+  uint64_t v;
+  memcpy(&v, ptr, 8);
+  return v;
+}
+
+// Case-insensitive match of "HTTP/1.x" against 8 bytes from the buffer
+#define PROTOCOL_MATCH(word, proto) (((word) | load64("\x20\x20\x20\x20\0\0\0\0")) == load64(proto))
+
+// Matches the common methods (in uppercase, followed by a space) directly in
+// the buffer, needs at least 8 buffered bytes. Returns the method length
+// including the space, or 0 if not matched.
+static inline int match_common_method(const char *ptr, VALUE *method) {
+  uint32_t word = load32(ptr);
+
+  if (word == load32("GET "))   { *method = STR_method_get;   return 4; }
+  if (word == load32("POST") && ptr[4] == ' ') { *method = STR_method_post; return 5; }
+  if (word == load32("PUT "))   { *method = STR_method_put;   return 4; }
+  if (word == load32("HEAD") && ptr[4] == ' ') { *method = STR_method_head; return 5; }
+  if (word == load32("PATC") && load32(ptr + 2) == load32("TCH ")) { *method = STR_method_patch; return 6; }
+  if (word == load32("DELE") && load32(ptr + 3) == load32("ETE ")) { *method = STR_method_delete; return 7; }
+  if (load64(ptr) == load64("OPTIONS ")) { *method = STR_method_options; return 8; }
+  return 0;
+}
+
+static inline int parse_request_line_method(Parser_t *parser) {
+  if (BUFFER_LEN(parser) - BUFFER_POS(parser) >= 8) {
+    VALUE method;
+    int len = match_common_method(BUFFER_PTR(parser, BUFFER_POS(parser)), &method);
+    if (len) {
+      SET_HEADER_PREALLOCATED_VALUE(parser, STR_pseudo_method, method, len);
+      return 1;
+    }
+  }
+
+  int pos = BUFFER_POS(parser);
+  int len = 0;
+
+  while (1) {
+    switch (BUFFER_CUR(parser)) {
+      case ' ':
+        if (len < 1 || len > MAX_METHOD_LENGTH) goto bad_request;
+        INC_BUFFER_POS(parser);
+        goto done;
+      case '\r':
+      case '\n':
+        goto bad_request;
+      default:
+        INC_BUFFER_POS(parser);
+        len++;
+        if (len > MAX_METHOD_LENGTH) goto bad_request;
+    }
+  }
+done:
+  SET_HEADER_UPCASE_VALUE_FROM_BUFFER(parser, STR_pseudo_method, pos, len);
+  return 1;
+bad_request:
+  RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid method");
+eof:
+  return 0;
+}
+
+static int parse_request_line_target(Parser_t *parser) {
+  while (BUFFER_CUR(parser) == ' ') INC_BUFFER_POS(parser);
+  int pos = BUFFER_POS(parser);
+  int len = 0;
+  while (1) {
+    SCAN_BUFFER(parser, scan_target, len, MAX_PATH_LENGTH);
+    if (len > MAX_PATH_LENGTH) goto bad_request;
+    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) {
+      FILL_BUFFER_OR_GOTO_EOF(parser);
+      continue;
+    }
+    switch (BUFFER_CUR(parser)) {
+      case ' ':
+        if (len < 1) goto bad_request;
+        INC_BUFFER_POS(parser);
+        goto done;
+      default:
+        // CR, LF or control character
+        goto bad_request;
+    }
+  }
+done:
+  SET_HEADER_VALUE_FROM_BUFFER(parser, STR_pseudo_path, pos, len);
+  return 1;
+bad_request:
+  RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid request target");
+eof:
+  return 0;
 }
 
 static int parse_request_line_protocol(Parser_t *parser) {
   while (BUFFER_CUR(parser) == ' ') INC_BUFFER_POS(parser);
+
+  if (BUFFER_LEN(parser) - BUFFER_POS(parser) >= 10) {
+    char *ptr = BUFFER_PTR(parser, BUFFER_POS(parser));
+    uint64_t word = load64(ptr);
+    int len = (ptr[8] == '\n') ? 9 : ((ptr[8] == '\r' && ptr[9] == '\n') ? 10 : 0);
+    if (len) {
+      if (PROTOCOL_MATCH(word, "http/1.1")) {
+        parser->framing |= FRAMING_HTTP_1_1;
+        SET_HEADER_PREALLOCATED_VALUE(parser, STR_pseudo_protocol, STR_protocol_http_1_1, len);
+        return 1;
+      }
+      if (PROTOCOL_MATCH(word, "http/1.0")) {
+        SET_HEADER_PREALLOCATED_VALUE(parser, STR_pseudo_protocol, STR_protocol_http_1_0, len);
+        return 1;
+      }
+    }
+  }
+
   int pos = BUFFER_POS(parser);
   int len = 0;
 
@@ -501,10 +1872,11 @@ static int parse_request_line_protocol(Parser_t *parser) {
   }
 done:
   if (len < 6 || len > 8) goto bad_request;
+  if (len == 8 && BUFFER_AT(parser, pos + 7) == '1') parser->framing |= FRAMING_HTTP_1_1;
   SET_HEADER_DOWNCASE_VALUE_FROM_BUFFER(parser, STR_pseudo_protocol, pos, len);
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid protocol");
+  RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid protocol");
 eof:
   return 0;
 }
@@ -520,6 +1892,22 @@ eof:
 }
 
 static inline int parse_status_line_protocol(Parser_t *parser) {
+  if (BUFFER_LEN(parser) - BUFFER_POS(parser) >= 9) {
+    char *ptr = BUFFER_PTR(parser, BUFFER_POS(parser));
+    uint64_t word = load64(ptr);
+    if (ptr[8] == ' ') {
+      if (PROTOCOL_MATCH(word, "http/1.1")) {
+        parser->framing |= FRAMING_HTTP_1_1;
+        SET_HEADER_PREALLOCATED_VALUE(parser, STR_pseudo_protocol, STR_protocol_http_1_1, 9);
+        return 1;
+      }
+      if (PROTOCOL_MATCH(word, "http/1.0")) {
+        SET_HEADER_PREALLOCATED_VALUE(parser, STR_pseudo_protocol, STR_protocol_http_1_0, 9);
+        return 1;
+      }
+    }
+  }
+
   int pos = BUFFER_POS(parser);
   int len = 0;
 
@@ -550,10 +1938,11 @@ static inline int parse_status_line_protocol(Parser_t *parser) {
   }
 done:
   if (len < 6 || len > 8) goto bad_request;
+  if (len == 8 && BUFFER_AT(parser, pos + 7) == '1') parser->framing |= FRAMING_HTTP_1_1;
   SET_HEADER_DOWNCASE_VALUE_FROM_BUFFER(parser, STR_pseudo_protocol, pos, len);
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid protocol");
+  RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid protocol");
 eof:
   return 0;
 }
@@ -587,7 +1976,7 @@ done:
   SET_HEADER_VALUE_INT(parser, STR_pseudo_status, status);
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid response status");
+  RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid response status");
 eof:
   return 0;
 }
@@ -597,6 +1986,12 @@ static inline int parse_status_line_status_message(Parser_t *parser) {
   int pos = BUFFER_POS(parser);
   int len = 0;
   while (1) {
+    SCAN_BUFFER(parser, scan_field_value, len, MAX_STATUS_MESSAGE_LENGTH);
+    if (len > MAX_STATUS_MESSAGE_LENGTH) goto bad_request;
+    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) {
+      FILL_BUFFER_OR_GOTO_EOF(parser);
+      continue;
+    }
     switch (BUFFER_CUR(parser)) {
       case '\r':
         CONSUME_CRLF(parser);
@@ -605,16 +2000,14 @@ static inline int parse_status_line_status_message(Parser_t *parser) {
         INC_BUFFER_POS(parser);
         goto done;
       default:
-        INC_BUFFER_POS(parser);
-        len++;
-        if (len > MAX_STATUS_MESSAGE_LENGTH) goto bad_request;
+        goto bad_request;
     }
   }
 done:
   SET_HEADER_VALUE_FROM_BUFFER(parser, STR_pseudo_status_message, pos, len);
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid request target");
+  RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid request target");
 eof:
   return 0;
 }
@@ -630,7 +2023,7 @@ eof:
   return 0;
 }
 
-static inline int parse_header_key(Parser_t *parser, VALUE *key) {
+static inline int parse_header_key(Parser_t *parser, int *key_pos, int *key_len) {
   int pos = BUFFER_POS(parser);
   int len = 0;
 
@@ -653,29 +2046,36 @@ static inline int parse_header_key(Parser_t *parser, VALUE *key) {
         INC_BUFFER_POS_NO_FILL(parser);
         goto done;
       default:
+        if (!token_lower[(unsigned char)BUFFER_CUR(parser)]) goto bad_request;
         INC_BUFFER_POS(parser);
         len++;
-        // INC_BUFFER_POS_UTF8(parser, len);
         if (len > MAX_HEADER_KEY_LENGTH) goto bad_request;
     }
   }
 done:
   if (len == 0) return -1;
-  (*key) = BUFFER_STR_DOWNCASE(parser, pos, len);
+  (*key_pos) = pos;
+  (*key_len) = len;
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid header key");
+  RAISE_PARSE_ERROR(parser, ERR_HEADER, "Invalid header key");
 eof:
   return 0;
 }
 
-static inline int parse_header_value(Parser_t *parser, VALUE *value) {
+static inline int parse_header_value(Parser_t *parser, int *value_pos, int *value_len) {
   while (BUFFER_CUR(parser) == ' ') INC_BUFFER_POS(parser);
 
   int pos = BUFFER_POS(parser);
   int len = 0;
 
   while (1) {
+    SCAN_BUFFER(parser, scan_field_value, len, MAX_HEADER_VALUE_LENGTH);
+    if (len > MAX_HEADER_VALUE_LENGTH) goto bad_request;
+    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) {
+      FILL_BUFFER_OR_GOTO_EOF(parser);
+      continue;
+    }
     switch (BUFFER_CUR(parser)) {
       case '\r':
         CONSUME_CRLF(parser);
@@ -684,43 +2084,125 @@ static inline int parse_header_value(Parser_t *parser, VALUE *value) {
         INC_BUFFER_POS(parser);
         goto done;
       default:
-        INC_BUFFER_POS_UTF8(parser, len);
-        if (len > MAX_HEADER_VALUE_LENGTH) goto bad_request;
+        goto bad_request;
     }
   }
 done:
   if (len < 1 || len > MAX_HEADER_VALUE_LENGTH) goto bad_request;
-  (*value) = BUFFER_STR(parser, pos, len);
+  (*value_pos) = pos;
+  (*value_len) = len;
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid header value");
+  RAISE_PARSE_ERROR(parser, ERR_HEADER, "Invalid header value");
 eof:
   return 0;
 }
 
+#define TOKEN_MATCH(ptr, len, str) \
+  ((len) == sizeof(str) - 1 && !strncasecmp((ptr), (str), sizeof(str) - 1))
+
+static inline int is_ows(char c) {
+  return c == ' ' || c == '\t';
+}
+
+// Calls fn for each comma-separated token in the given header value, with
+// surrounding whitespace trimmed.
+#define FOR_EACH_TOKEN(ptr, len, fn, arg) { \
+  int start = 0; \
+  for (int i = 0; i <= (len); i++) { \
+    if (i < (len) && (ptr)[i] != ',') continue; \
+    int s = start, e = i; \
+    while (s < e && is_ows((ptr)[s])) s++; \
+    while (e > s && is_ows((ptr)[e - 1])) e--; \
+    fn((arg), (ptr) + s, e - s); \
+    start = i + 1; \
+  } \
+}
+
+static inline void connection_token(Parser_t *parser, const char *ptr, int len) {
+  if (TOKEN_MATCH(ptr, len, "close"))
+    parser->framing |= FRAMING_CONNECTION_CLOSE;
+  else if (TOKEN_MATCH(ptr, len, "keep-alive"))
+    parser->framing |= FRAMING_CONNECTION_KEEP_ALIVE;
+  else if (TOKEN_MATCH(ptr, len, "upgrade"))
+    parser->framing |= FRAMING_CONNECTION_UPGRADE;
+}
+
+static inline void transfer_coding(Parser_t *parser, const char *ptr, int len) {
+  // only the last transfer coding determines whether the body is chunked
+  if (TOKEN_MATCH(ptr, len, "chunked"))
+    parser->framing |= FRAMING_CHUNKED;
+  else if (len)
+    parser->framing &= ~FRAMING_CHUNKED;
+}
+
+static inline void parse_content_length(Parser_t *parser, const char *ptr, int len) {
+  int64_t value = 0;
+  if (!len) goto invalid;
+  for (int i = 0; i < len; i++) {
+    if (ptr[i] < '0' || ptr[i] > '9') goto invalid;
+    int digit = ptr[i] - '0';
+    if (value > (INT64_MAX - digit) / 10) goto invalid;
+    value = value * 10 + digit;
+  }
+  // repeated Content-Length headers must have the same value
+  if (parser->content_length >= 0 && parser->content_length != value) goto invalid;
+  parser->content_length = value;
+  return;
+invalid:
+  parser->framing |= FRAMING_INVALID_CONTENT_LENGTH;
+}
+
+// Records framing metadata from headers that determine message framing and
+// connection reuse. Other headers are rejected by their key length alone.
+static inline void parse_framing_header(Parser_t *parser, const char *key, int key_len, const char *value, int value_len) {
+  switch (key_len) {
+    case 6:
+      if (TOKEN_MATCH(key, key_len, "expect") && TOKEN_MATCH(value, value_len, "100-continue"))
+        parser->framing |= FRAMING_EXPECT_CONTINUE;
+      return;
+    case 7:
+      if (TOKEN_MATCH(key, key_len, "upgrade"))
+        parser->framing |= FRAMING_UPGRADE;
+      return;
+    case 10:
+      if (TOKEN_MATCH(key, key_len, "connection"))
+        FOR_EACH_TOKEN(value, value_len, connection_token, parser);
+      return;
+    case 14:
+      if (TOKEN_MATCH(key, key_len, "content-length"))
+        parse_content_length(parser, value, value_len);
+      return;
+    case 17:
+      if (TOKEN_MATCH(key, key_len, "transfer-encoding"))
+        FOR_EACH_TOKEN(value, value_len, transfer_coding, parser);
+      return;
+  }
+}
+
 static inline int parse_header(Parser_t *parser) {
-  VALUE key, value;
+  int key_pos, key_len, value_pos, value_len;
 
-  switch (parse_header_key(parser, &key)) {
+  switch (parse_header_key(parser, &key_pos, &key_len)) {
     case -1: return -1;
     case 0: goto eof;
   }
 
-  if (!parse_header_value(parser, &value)) goto eof;
+  if (!parse_header_value(parser, &value_pos, &value_len)) goto eof;
+  parse_framing_header(parser, BUFFER_PTR(parser, key_pos), key_len, BUFFER_PTR(parser, value_pos), value_len);
 
-  VALUE existing = rb_hash_aref(parser->headers, key);
-  if (existing != Qnil) {
-    if (TYPE(existing) != T_ARRAY) {
-      existing = rb_ary_new3(2, existing, value);
-      rb_hash_aset(parser->headers, key, existing);
-    }
-    else
-      rb_ary_push(existing, value);
+  if (parser->lazy) {
+    Headers_add(
+      parser->headers, key_pos - parser->request_pos, key_len,
+      value_pos - parser->request_pos, value_len
+    );
+    return 1;
   }
-  else
-    rb_hash_aset(parser->headers, key, value);
 
-  RB_GC_GUARD(existing);
+  VALUE key = header_key_str(BUFFER_PTR(parser, key_pos), key_len);
+  VALUE value = BUFFER_STR(parser, value_pos, value_len);
+  hash_add_header(parser->headers, key, value);
+
   RB_GC_GUARD(key);
   RB_GC_GUARD(value);
   return 1;
@@ -728,26 +2210,75 @@ eof:
   return 0;
 }
 
+// Returns a new headers hash, presized according to the number of headers in
+// recent messages.
+static inline VALUE headers_hash_new(Parser_t *parser) {
+#ifdef HAVE_RB_HASH_NEW_CAPA
+  return rb_hash_new_capa((parser->header_count_avg >> HEADER_COUNT_AVG_SHIFT) + PSEUDO_HEADER_COUNT);
+#else
+  return rb_hash_new();
+#endif
+}
+
+static inline int parse_start_line(Parser_t *parser) {
+  return (parser->mode == mode_server) ?
+    parse_request_line(parser) : parse_status_line(parser);
+}
+
+// Sets up parser->headers, which is either nil (a new headers object is
+// created) or a cleared hash to be reused, for a message starting at the
+// current buffer position.
+static inline void parse_headers_begin(Parser_t *parser) {
+  if (parser->lazy)
+    parser->headers = Headers_new(parser->mode);
+  else if (parser->headers == Qnil)
+    parser->headers = headers_hash_new(parser);
+
+  parser->request_pos = parser->buf_pos;
+  parser->current_request_rx = 0;
+  parser->framing = 0;
+  parser->content_length = -1;
+  parser->trailers = Qnil;
+  parser->trailer_count = 0;
+  parser->trailer_len = 0;
+}
+
+// Finalizes the parsed headers. parser->headers is nil if the headers are
+// incomplete.
+static inline void parse_headers_end(Parser_t *parser, int header_count) {
+  parser->body_read_mode = BODY_READ_MODE_UNKNOWN;
+  int read_bytes = BUFFER_POS(parser) - parser->request_pos;
+
+  parser->current_request_rx += read_bytes;
+  if (parser->headers != Qnil) {
+    STATS_ADD(parser, requests, 1);
+    timings_record(parser, &parser->ts_headers_done);
+    // Decay the read size if messages are much smaller
+    if (read_bytes * 4 < parser->read_size && parser->read_size > parser->min_buffer_size) {
+      parser->read_size /= 2;
+      if (parser->read_size < parser->min_buffer_size) parser->read_size = parser->min_buffer_size;
+    }
+    parser->header_count_avg += header_count - (parser->header_count_avg >> HEADER_COUNT_AVG_SHIFT);
+    if (parser->lazy) Headers_set_block(parser->headers, BUFFER_PTR(parser, parser->request_pos), read_bytes);
+    set_rx(parser, read_bytes);
+  }
+}
+
 VALUE Parser_parse_headers_safe(VALUE self) {
   Parser_t *parser;
   GetParser(self, parser);
-  parser->headers = rb_hash_new();
+  int header_count = 0;
 
+  parser_buffer_release(parser, parser->buf_pos);
   buffer_trim(parser);
-  int initial_pos = parser->buf_pos;
+  timings_message_start(parser);
+  parse_headers_begin(parser);
   INIT_PARSER_STATE(parser);
-  parser->current_request_rx = 0;
 
-  if (parser->mode == mode_server) {
-    if (!parse_request_line(parser)) goto eof;
-  }
-  else {
-    if (!parse_status_line(parser)) goto eof;
-  }
+  if (!parse_start_line(parser)) goto eof;
 
-  int header_count = 0;
   while (1) {
-    if (header_count > MAX_HEADER_COUNT) RAISE_BAD_REQUEST("Too many headers");
+    if (header_count > MAX_HEADER_COUNT) RAISE_PARSE_ERROR(parser, ERR_HEADER, "Too many headers");
     switch (parse_header(parser)) {
       case -1: goto done; // empty header => end of headers
       case 0: goto eof;
@@ -756,26 +2287,28 @@ VALUE Parser_parse_headers_safe(VALUE self) {
   }
 eof:
   parser->headers = Qnil;
+  // return the buffer to the pool if no partial message is buffered
+  parser_buffer_release(parser, parser->request_pos);
 done:
-  parser->body_read_mode = BODY_READ_MODE_UNKNOWN;
-  int read_bytes = BUFFER_POS(parser) - initial_pos;
-
-  parser->current_request_rx += read_bytes;
-  if (parser->headers != Qnil)
-    rb_hash_aset(parser->headers, STR_pseudo_rx, INT2FIX(read_bytes));
+  parse_headers_end(parser, header_count);
   return parser->headers;
 }
 
 noreturn VALUE Parser_parse_headers_rescue(VALUE args, VALUE error) {
-  RAISE_BAD_REQUEST("Invalid character sequences in method or header name");
+  Parser_t *parser;
+  GetParser(args, parser);
+  RAISE_PARSE_ERROR(parser, ERR_HEADER, "Invalid character sequences in method or header name");
 }
 
 /* call-seq: parser.parse_headers -> headers
+ *            parser.parse_headers(hash) -> hash
  *
  * Parses headers from the associated IO instance, returning a hash mapping
- * header keys to their respective values. Header keys are downcased and dashes
- * are converted to underscores. The returned headers will also include the
- * following pseudo-headers:
+ * header keys to their respective values (or an `H1P::Headers` instance in lazy
+ * mode). Header keys are downcased and dashes are converted to underscores.
+ * If a hash is given, it is cleared and filled with the parsed headers instead
+ * of allocating a new hash (this is not supported in lazy mode).
+ * The returned headers will also include the following pseudo-headers:
  * 
  * - `':protocol'` - the protocol as specified in the query line / status line
  * - `':path'` - the query path (for HTTP requests)
@@ -783,7 +2316,19 @@ noreturn VALUE Parser_parse_headers_rescue(VALUE args, VALUE error) {
  * - `':status'` - the HTTP status (for HTTP responses)
  * - `':rx'` - the total number of bytes read by the parser
  */
-VALUE Parser_parse_headers(VALUE self) {
+VALUE Parser_parse_headers(int argc, VALUE *argv, VALUE self) {
+  Parser_t *parser;
+  VALUE hash;
+  GetParser(self, parser);
+
+  rb_scan_args(argc, argv, "01", &hash);
+  if (hash != Qnil) {
+    if (parser->lazy) rb_raise(eArgumentError, "Cannot reuse a hash in lazy mode");
+    Check_Type(hash, T_HASH);
+    rb_hash_clear(hash);
+  }
+  parser->headers = hash;
+
   return rb_rescue2(
     Parser_parse_headers_safe, self,
     Parser_parse_headers_rescue, self,
@@ -793,167 +2338,346 @@ VALUE Parser_parse_headers(VALUE self) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static inline int str_to_int(VALUE value, const char *error_msg) {
-  char *ptr = RSTRING_PTR(value);
-  int len = RSTRING_LEN(value);
-  int int_value = 0;
-
-  while (len) {
-    char c = *ptr;
-    if ((c >= '0') && (c <= '9'))
-      int_value = int_value * 10 + (c - '0');
-    else
-      RAISE_BAD_REQUEST(error_msg);
-    len--;
-    ptr++;
+// Reads up to maxlen bytes of body data from the IO, appending them to *body
+// (or setting *body to a new string). Returns the number of bytes read, or 0 on
+// EOF.
+static inline long read_body_data(Parser_t *parser, VALUE *body, int maxlen) {
+  if (*body == Qnil) {
+    *body = parser_io_read(parser, INT2FIX(maxlen), Qnil, NUM_buffer_start);
+    return (*body == Qnil) ? 0 : RSTRING_LEN(*body);
   }
 
-  return int_value;
+  long len = RSTRING_LEN(*body);
+  VALUE ret = parser_io_read(parser, INT2FIX(maxlen), *body, NUM_buffer_end);
+  if (ret == Qnil) return 0;
+
+  *body = ret;
+  return RSTRING_LEN(ret) - len;
 }
 
-VALUE read_body_with_content_length(Parser_t *parser, int read_entire_body, int buffered_only) {
+// Reads the body into the given string, or into a new string if body is nil.
+// When reading a single chunk into a given string, the read is limited to the
+// string's capacity (but no less than INITIAL_BUFFER_SIZE).
+VALUE read_body_with_content_length(Parser_t *parser, VALUE body, int read_entire_body, int buffered_only) {
   if (parser->body_left <= 0) return Qnil;
 
-  VALUE body = Qnil;
-
-  int len = RSTRING_LEN(parser->buffer);
+  int limit_to_capacity = (body != Qnil) && !read_entire_body;
+  int len = BUFFER_LEN(parser);
   int pos = BUFFER_POS(parser);
 
   if (pos < len) {
     int available = len - pos;
     if (available > parser->body_left) available = parser->body_left;
-    body = rb_str_new(RSTRING_PTR(parser->buffer) + pos, available);
+    if (body != Qnil)
+      str_append_from_buffer(body, BUFFER_PTR(parser, pos), available);
+    else
+      body = rb_str_new(BUFFER_PTR(parser, pos), available);
     BUFFER_POS(parser) += available;
     parser->current_request_rx += available;
+    STATS_ADD(parser, body_bytes_read, available);
     parser->body_left -= available;
-    if (!parser->body_left) parser->request_completed = 1;
-  }
-  else {
-    body = Qnil;
-    len = 0;
+    if (!parser->body_left) set_request_completed(parser);
   }
   if (buffered_only) return body;
 
   while (parser->body_left) {
-    int maxlen = parser->body_left <= MAX_BODY_READ_LENGTH ? parser->body_left : MAX_BODY_READ_LENGTH;
-    VALUE tmp_buf = parser_io_read(parser, INT2FIX(maxlen), Qnil, NUM_buffer_start);
-    if (tmp_buf == Qnil) goto eof;
-    if (body != Qnil)
-      rb_str_append(body, tmp_buf);
-    else
-      body = tmp_buf;
-    int read_bytes = RSTRING_LEN(tmp_buf);
+    int maxlen = parser->body_left < MAX_BODY_READ_LENGTH ? (int)parser->body_left : MAX_BODY_READ_LENGTH;
+    if (limit_to_capacity) {
+      long capa = rb_str_capacity(body);
+      if (capa < INITIAL_BUFFER_SIZE) capa = INITIAL_BUFFER_SIZE;
+      long room = capa - RSTRING_LEN(body);
+      if (room <= 0) goto done;
+      if (maxlen > room) maxlen = room;
+    }
+    long read_bytes = read_body_data(parser, &body, maxlen);
+    if (!read_bytes) goto eof;
     parser->current_request_rx += read_bytes;
+    STATS_ADD(parser, body_bytes_read, read_bytes);
     parser->body_left -= read_bytes;
-    if (!parser->body_left) parser->request_completed = 1;
-    RB_GC_GUARD(tmp_buf);
+    if (!parser->body_left) set_request_completed(parser);
     if (!read_entire_body) goto done;
   }
 done:
-  rb_hash_aset(parser->headers, STR_pseudo_rx, INT2FIX(parser->current_request_rx));
+  set_rx(parser, parser->current_request_rx);
   RB_GC_GUARD(body);
   return body;
 eof:
-  RAISE_BAD_REQUEST("Incomplete body");
+  RAISE_PARSE_ERROR(parser, ERR_INCOMPLETE_BODY, "Incomplete body");
 }
 
-int chunked_encoding_p(VALUE transfer_encoding) {
-  if (transfer_encoding == Qnil) return 0;
-  return rb_funcall(str_downcase(transfer_encoding), ID_eq, 1, STR_chunked) == Qtrue;
+
+
+static inline int hex_digit(char c) {
+  if ((c >= '0') && (c <= '9')) return c - '0';
+  if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+  return -1;
 }
 
-int parse_chunk_size(Parser_t *parser, int *chunk_size) {
-  int len = 0;
-  int value = 0;
-  int initial_pos = BUFFER_POS(parser);
+#define SKIP_BWS(ptr, i, len) while (i < len && (ptr[i] == ' ' || ptr[i] == '\t')) i++
 
+// Validates chunk extensions, i.e. *( BWS ";" BWS name [ BWS "=" BWS value ] ),
+// where the value is either a token or a quoted string. Extensions are not
+// otherwise used.
+static int chunk_extensions_valid(const char *ptr, int len) {
+  int i = 0;
   while (1) {
-    char c = BUFFER_CUR(parser);
-    if ((c >= '0') && (c <= '9'))       value = (value << 4) + (c - '0');
-    else if ((c >= 'a') && (c <= 'f'))  value = (value << 4) + (c - 'a' + 10);
-    else if ((c >= 'A') && (c <= 'F'))  value = (value << 4) + (c - 'A' + 10);
-    else switch (c) {
-      case '\r':
-        CONSUME_CRLF_NO_FILL(parser);
-        goto done;
-      case '\n':
-        INC_BUFFER_POS_NO_FILL(parser);
-        goto done;
-      default:
-        goto bad_request;
+    SKIP_BWS(ptr, i, len);
+    if (i == len) return 1;
+    if (ptr[i++] != ';') return 0;
+    SKIP_BWS(ptr, i, len);
+    int start = i;
+    while (i < len && token_lower[(unsigned char)ptr[i]]) i++;
+    if (i == start) return 0;
+    SKIP_BWS(ptr, i, len);
+    if (i == len || ptr[i] != '=') continue;
+    i++;
+    SKIP_BWS(ptr, i, len);
+    if (i < len && ptr[i] == '"') {
+      i++;
+      while (1) {
+        if (i == len) return 0;
+        unsigned char c = ptr[i++];
+        if (c == '"') break;
+        if (c == '\\') {
+          if (i == len) return 0;
+          c = ptr[i++];
+        }
+        if ((c < 0x20 && c != '\t') || c == 0x7f) return 0;
+      }
+    }
+    else {
+      start = i;
+      while (i < len && token_lower[(unsigned char)ptr[i]]) i++;
+      if (i == start) return 0;
     }
-    INC_BUFFER_POS(parser);
-    len++;
-    if (len >= MAX_CHUNKED_ENCODING_CHUNK_SIZE_LENGTH) goto bad_request;
   }
-done:
-  if (len == 0) goto bad_request;
-  (*chunk_size) = value;
-  parser->current_request_rx += BUFFER_POS(parser) - initial_pos;
-  return 1;
-bad_request:
-  RAISE_BAD_REQUEST("Invalid chunk size");
-eof:
-  return 0;
 }
 
-int read_body_chunk_with_chunked_encoding(Parser_t *parser, VALUE *body, int chunk_size, int buffered_only) {
-  int len = RSTRING_LEN(parser->buffer);
-  int pos = BUFFER_POS(parser);
-  int left = chunk_size;
+// Scans a chunk header line (chunk size, optional chunk extensions and line
+// ending) at the given location. Returns the length of the line, 0 if the line
+// is incomplete, or -1 if it is invalid.
+static int chunk_header_scan(const char *ptr, int len, int64_t *chunk_size) {
+  const char *lf = memchr(ptr, '\n', len < MAX_CHUNK_HEADER_LENGTH ? len : MAX_CHUNK_HEADER_LENGTH);
+  if (!lf) return (len >= MAX_CHUNK_HEADER_LENGTH) ? -1 : 0;
+
+  int line_len = lf - ptr + 1;
+  int n = line_len - 1;
+  if (n && ptr[n - 1] == '\r') n--;
+
+  int64_t value = 0;
+  int i = 0;
+  for (; i < n; i++) {
+    int digit = hex_digit(ptr[i]);
+    if (digit < 0) break;
+    if (i + 1 >= MAX_CHUNKED_ENCODING_CHUNK_SIZE_LENGTH) return -1;
+    if (value > (INT64_MAX >> 4)) return -1;
+    value = (value << 4) + digit;
+  }
+  if (!i) return -1;
+  if (i < n && !chunk_extensions_valid(ptr + i, n - i)) return -1;
 
-  if (pos < len) {
-    int available = len - pos;
-    if (available > left) available = left;
+  *chunk_size = value;
+  return line_len;
+}
+
+// Parses a trailer field line at the given location, adding the field to the
+// parser's trailers. Returns the length of the line, 0 if the line is
+// incomplete, or -1 if it is invalid. *end is set on the empty line ending the
+// trailer section. Raises if the trailer section exceeds the size or field
+// count limits.
+static int trailer_line_parse(Parser_t *parser, const char *ptr, int len, int *end) {
+  const char *lf = memchr(ptr, '\n', len < MAX_HEADER_LINE_LENGTH ? len : MAX_HEADER_LINE_LENGTH);
+  if (!lf) return (len >= MAX_HEADER_LINE_LENGTH) ? -1 : 0;
+
+  int line_len = lf - ptr + 1;
+  parser->trailer_len += line_len;
+  if (parser->trailer_len > MAX_TRAILERS_LENGTH)
+    RAISE_PARSE_ERROR(parser, ERR_HEADER, "Trailers too large");
+  int n = line_len - 1;
+  if (n && ptr[n - 1] == '\r') n--;
+  if (!n) {
+    *end = 1;
+    return line_len;
+  }
+
+  int key_len = 0;
+  while (key_len < n && token_lower[(unsigned char)ptr[key_len]]) key_len++;
+  if (!key_len || key_len > MAX_HEADER_KEY_LENGTH || key_len == n || ptr[key_len] != ':') return -1;
+
+  int value_pos = key_len + 1;
+  SKIP_BWS(ptr, value_pos, n);
+  int value_end = n;
+  while (value_end > value_pos && (ptr[value_end - 1] == ' ' || ptr[value_end - 1] == '\t')) value_end--;
+  int value_len = value_end - value_pos;
+  if (value_len > MAX_HEADER_VALUE_LENGTH) return -1;
+  if ((int)scan_field_value(ptr + value_pos, value_len) != value_len) return -1;
+
+  if (++parser->trailer_count > MAX_HEADER_COUNT)
+    RAISE_PARSE_ERROR(parser, ERR_HEADER, "Too many trailers");
+  if (parser->trailers == Qnil) parser->trailers = rb_hash_new();
+  VALUE value = rb_obj_freeze(rb_utf8_str_new(ptr + value_pos, value_len));
+  hash_add_header(parser->trailers, header_key_str(ptr, key_len), value);
+  return line_len;
+}
+
+int parse_chunk_size(Parser_t *parser, int64_t *chunk_size) {
+  while (1) {
+    int len = chunk_header_scan(BUFFER_PTR(parser, BUFFER_POS(parser)), BUFFER_LEN(parser) - BUFFER_POS(parser), chunk_size);
+    if (len < 0) goto bad_request;
+    if (len) {
+      BUFFER_POS(parser) += len;
+      parser->current_request_rx += len;
+      return 1;
+    }
+    FILL_BODY_BUFFER_OR_GOTO_EOF(parser);
+  }
+bad_request:
+  RAISE_PARSE_ERROR(parser, ERR_BODY, "Invalid chunk size");
+eof:
+  return 0;
+}
+
+// Parses the trailer section following the last chunk, up to and including the
+// empty line ending the message.
+static inline int parse_trailers(Parser_t *parser) {
+  int end = 0;
+  while (!end) {
+    int len = trailer_line_parse(parser, BUFFER_PTR(parser, BUFFER_POS(parser)), BUFFER_LEN(parser) - BUFFER_POS(parser), &end);
+    if (len < 0) goto bad_request;
+    if (!len) {
+      FILL_BODY_BUFFER_OR_GOTO_EOF(parser);
+      continue;
+    }
+    BUFFER_POS(parser) += len;
+    parser->current_request_rx += len;
+  }
+  return 1;
+bad_request:
+  RAISE_PARSE_ERROR(parser, ERR_BODY, "Invalid trailer");
+eof:
+  return 0;
+}
+
+// Returns the length of a complete chunk (header, data and line ending) at the
+// given buffer position, or 0 if the chunk is incomplete, invalid or is the
+// last chunk. The length of the chunk header is stored in *header_len.
+static inline int buffered_chunk_length(Parser_t *parser, int pos, int *header_len, int64_t *chunk_size) {
+  int len = BUFFER_LEN(parser);
+  *header_len = chunk_header_scan(BUFFER_PTR(parser, pos), len - pos, chunk_size);
+  if (*header_len <= 0 || !*chunk_size) return 0;
+  // the data must be followed by at least a LF
+  if (*chunk_size >= len - pos - *header_len) return 0;
+
+  int end = pos + *header_len + (int)*chunk_size;
+  if (BUFFER_AT(parser, end) == '\n') return end + 1 - pos;
+  if (BUFFER_AT(parser, end) == '\r' && end + 1 < len && BUFFER_AT(parser, end + 1) == '\n')
+    return end + 2 - pos;
+  return 0;
+}
+
+#define MAX_BUFFERED_CHUNKS 64
+
+// Position and length of the data of a buffered chunk
+typedef struct chunk_span {
+  int pos;
+  int len;
+} chunk_span_t;
+
+// Decodes complete chunks in the buffer (up to MAX_BUFFERED_CHUNKS at a time),
+// appending their data to the body. The chunk headers are parsed in a single
+// pass recording the data spans and the total payload, so the body is grown at
+// most once, after which the chunk data is copied. Returns the number of
+// chunks decoded.
+static int read_buffered_chunks(Parser_t *parser, VALUE *body) {
+  chunk_span_t spans[MAX_BUFFERED_CHUNKS];
+  int header_len;
+  int64_t chunk_size;
+  int count = 0;
+  long total = 0;
+
+  int end = BUFFER_POS(parser);
+  while (count < MAX_BUFFERED_CHUNKS) {
+    int chunk_len = buffered_chunk_length(parser, end, &header_len, &chunk_size);
+    if (!chunk_len) break;
+    spans[count++] = (chunk_span_t){end + header_len, (int)chunk_size};
+    total += chunk_size;
+    end += chunk_len;
+  }
+  if (!count) return 0;
+
+  if (*body == Qnil)
+    *body = rb_str_buf_new(total);
+  else
+    str_reserve(*body, total);
+
+  long body_len = RSTRING_LEN(*body);
+  char *dest = RSTRING_PTR(*body) + body_len;
+  for (int i = 0; i < count; i++) {
+    memcpy(dest, BUFFER_PTR(parser, spans[i].pos), spans[i].len);
+    dest += spans[i].len;
+  }
+  rb_str_set_len(*body, body_len + total);
+
+  parser->current_request_rx += end - BUFFER_POS(parser);
+  STATS_ADD(parser, body_bytes_read, total);
+  BUFFER_POS(parser) = end;
+  return count;
+}
+
+int read_body_chunk_with_chunked_encoding(Parser_t *parser, VALUE *body, int64_t chunk_size, int buffered_only) {
+  int len = BUFFER_LEN(parser);
+  int pos = BUFFER_POS(parser);
+  int64_t left = chunk_size;
+
+  if (pos < len) {
+    int available = len - pos;
+    if (available > left) available = left;
     if (*body != Qnil)
-      str_append_from_buffer(*body, RSTRING_PTR(parser->buffer) + pos, available);
+      str_append_from_buffer(*body, BUFFER_PTR(parser, pos), available);
     else
-      *body = rb_str_new(RSTRING_PTR(parser->buffer) + pos, available);
+      *body = rb_str_new(BUFFER_PTR(parser, pos), available);
     BUFFER_POS(parser) += available;
     parser->current_request_rx += available;
+    STATS_ADD(parser, body_bytes_read, available);
     left -= available;
   }
   if (buffered_only) return 1;
 
   while (left) {
-    int maxlen = left <= MAX_BODY_READ_LENGTH ? left : MAX_BODY_READ_LENGTH;
+    int maxlen = left < MAX_BODY_READ_LENGTH ? (int)left : MAX_BODY_READ_LENGTH;
 
-    VALUE tmp_buf = parser_io_read(parser, INT2FIX(maxlen), Qnil, NUM_buffer_start);
-    if (tmp_buf == Qnil) goto eof;
-    if (*body != Qnil)
-      rb_str_append(*body, tmp_buf);
-    else
-      *body = tmp_buf;
-    int read_bytes = RSTRING_LEN(tmp_buf);
+    long read_bytes = read_body_data(parser, body, maxlen);
+    if (!read_bytes) goto eof;
     parser->current_request_rx += read_bytes;
+    STATS_ADD(parser, body_bytes_read, read_bytes);
     left -= read_bytes;
-    RB_GC_GUARD(tmp_buf);
   }
   return 1;
 eof:
   return 0;
 }
 
-int splice_body_chunk_with_chunked_encoding(Parser_t *parser, VALUE dest, int chunk_size, enum write_method method) {
-  int len = RSTRING_LEN(parser->buffer);
+int splice_body_chunk_with_chunked_encoding(Parser_t *parser, VALUE dest, int64_t chunk_size, enum write_method method) {
+  int len = BUFFER_LEN(parser);
   int pos = BUFFER_POS(parser);
-  int left = chunk_size;
+  int64_t left = chunk_size;
 
   if (pos < len) {
     int available = len - pos;
     if (available > left) available = left;
-    VALUE buf = rb_str_new(RSTRING_PTR(parser->buffer) + pos, available);
+    parser_io_write(dest, BUFFER_PTR(parser, pos), available, method);
     BUFFER_POS(parser) += available;
     parser->current_request_rx += available;
-    parser_io_write(dest, buf, method);
-    RB_GC_GUARD(buf);
+    STATS_ADD(parser, body_bytes_spliced, available);
     left -= available;
   }
 
   while (left) {
-    int spliced = parser_io_splice(parser->io, dest, left);
+    int spliced = parser_io_splice(parser, dest, left, method);
     if (!spliced) goto eof;
     parser->current_request_rx += spliced;
+    STATS_ADD(parser, body_bytes_spliced, spliced);
     left -= spliced;
   }
   return 1;
@@ -962,51 +2686,48 @@ eof:
 }
 
 static inline int parse_chunk_postfix(Parser_t *parser) {
-  int initial_pos = BUFFER_POS(parser);
-  if (initial_pos == BUFFER_LEN(parser)) FILL_BUFFER_OR_GOTO_EOF(parser);
-  switch (BUFFER_CUR(parser)) {
-    case '\r':
-      CONSUME_CRLF_NO_FILL(parser);
-      goto done;
-    case '\n':
-      INC_BUFFER_POS_NO_FILL(parser);
-      goto done;
-    default:
-      goto bad_request;
+  if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BODY_BUFFER_OR_GOTO_EOF(parser);
+  if (BUFFER_CUR(parser) == '\r') {
+    BUFFER_POS(parser)++;
+    parser->current_request_rx++;
+    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BODY_BUFFER_OR_GOTO_EOF(parser);
   }
-done:
-  parser->current_request_rx += BUFFER_POS(parser) - initial_pos;
+  if (BUFFER_CUR(parser) != '\n') goto bad_request;
+  BUFFER_POS(parser)++;
+  parser->current_request_rx++;
   return 1;
 bad_request:
-  RAISE_BAD_REQUEST("Invalid chunk");
+  RAISE_PARSE_ERROR(parser, ERR_BODY, "Invalid chunk");
 eof:
   return 0;
 }
 
-VALUE read_body_with_chunked_encoding(Parser_t *parser, int read_entire_body, int buffered_only) {
+// Reads the body into the given string, or into a new string if body is nil.
+VALUE read_body_with_chunked_encoding(Parser_t *parser, VALUE body, int read_entire_body, int buffered_only) {
   buffer_trim(parser);
   INIT_PARSER_STATE(parser);
-  VALUE body = Qnil;
 
   while (1) {
-    int chunk_size = 0;
-    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BUFFER_OR_GOTO_EOF(parser);
+    int64_t chunk_size = 0;
+    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BODY_BUFFER_OR_GOTO_EOF(parser);
+    if (read_entire_body && read_buffered_chunks(parser, &body)) continue;
     if (!parse_chunk_size(parser, &chunk_size)) goto bad_request;
 
-    if (chunk_size) {
-      if (!read_body_chunk_with_chunked_encoding(parser, &body, chunk_size, buffered_only)) goto bad_request;
+    if (!chunk_size) {
+      if (!parse_trailers(parser)) goto bad_request;
+      set_request_completed(parser);
+      goto done;
     }
-    else parser->request_completed = 1;
-
+    if (!read_body_chunk_with_chunked_encoding(parser, &body, chunk_size, buffered_only)) goto bad_request;
     if (!parse_chunk_postfix(parser)) goto bad_request;
-    if (!chunk_size || !read_entire_body) goto done;
+    if (!read_entire_body) goto done;
   }
 bad_request:
-  RAISE_BAD_REQUEST("Malformed request body");
+  RAISE_PARSE_ERROR(parser, ERR_BODY, "Malformed request body");
 eof:
-  RAISE_BAD_REQUEST("Incomplete request body");
+  RAISE_PARSE_ERROR(parser, ERR_INCOMPLETE_BODY, "Incomplete request body");
 done:
-  rb_hash_aset(parser->headers, STR_pseudo_rx, INT2FIX(parser->current_request_rx));
+  set_rx(parser, parser->current_request_rx);
   RB_GC_GUARD(body);
   return body;
 }
@@ -1016,80 +2737,83 @@ void splice_body_with_chunked_encoding(Parser_t *parser, VALUE dest, enum write_
   INIT_PARSER_STATE(parser);
 
   while (1) {
-    int chunk_size = 0;
-    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BUFFER_OR_GOTO_EOF(parser);
+    int64_t chunk_size = 0;
+    if (BUFFER_POS(parser) == BUFFER_LEN(parser)) FILL_BODY_BUFFER_OR_GOTO_EOF(parser);
     if (!parse_chunk_size(parser, &chunk_size)) goto bad_request;
 
-    if (chunk_size) {
-      if (!splice_body_chunk_with_chunked_encoding(parser, dest, chunk_size, method))
-        goto bad_request;
+    if (!chunk_size) {
+      if (!parse_trailers(parser)) goto bad_request;
+      set_request_completed(parser);
+      goto done;
     }
-    else
-      parser->request_completed = 1;
+    if (!splice_body_chunk_with_chunked_encoding(parser, dest, chunk_size, method))
+      goto bad_request;
 
     // read post-chunk delimiter ("\r\n")
     if (!parse_chunk_postfix(parser)) goto bad_request;
-    if (!chunk_size) goto done;
   }
 bad_request:
-  RAISE_BAD_REQUEST("Malformed request body");
+  RAISE_PARSE_ERROR(parser, ERR_BODY, "Malformed request body");
 eof:
-  RAISE_BAD_REQUEST("Incomplete request body");
+  RAISE_PARSE_ERROR(parser, ERR_INCOMPLETE_BODY, "Incomplete request body");
 done:
-  rb_hash_aset(parser->headers, STR_pseudo_rx, INT2FIX(parser->current_request_rx));
+  set_rx(parser, parser->current_request_rx);
 }
 
 void splice_body_with_content_length(Parser_t *parser, VALUE dest, enum write_method method)  {
   if (parser->body_left <= 0) return;
 
-  int len = RSTRING_LEN(parser->buffer);
+  int len = BUFFER_LEN(parser);
   int pos = BUFFER_POS(parser);
 
   if (pos < len) {
     int available = len - pos;
     if (available > parser->body_left) available = parser->body_left;
-    VALUE buf = rb_str_new(RSTRING_PTR(parser->buffer) + pos, available);
+    parser_io_write(dest, BUFFER_PTR(parser, pos), available, method);
     BUFFER_POS(parser) += available;
-    parser_io_write(dest, buf, method);
-    RB_GC_GUARD(buf);
     parser->current_request_rx += available;
+    STATS_ADD(parser, body_bytes_spliced, available);
     parser->body_left -= available;
-    if (!parser->body_left) parser->request_completed = 1;
+    if (!parser->body_left) set_request_completed(parser);
   }
 
   while (parser->body_left) {
-    int spliced = parser_io_splice(parser->io, dest, parser->body_left);
+    int spliced = parser_io_splice(parser, dest, parser->body_left, method);
     if (!spliced) goto eof;
     parser->current_request_rx += spliced;
+    STATS_ADD(parser, body_bytes_spliced, spliced);
     parser->body_left -= spliced;
   }
-  rb_hash_aset(parser->headers, STR_pseudo_rx, INT2FIX(parser->current_request_rx));
+  set_request_completed(parser);
+  set_rx(parser, parser->current_request_rx);
   return;
 eof:
-  RAISE_BAD_REQUEST("Incomplete body");
+  RAISE_PARSE_ERROR(parser, ERR_INCOMPLETE_BODY, "Incomplete body");
 }
 
 static inline void detect_body_read_mode(Parser_t *parser) {
-  VALUE content_length = rb_hash_aref(parser->headers, STR_content_length);
-  if (content_length != Qnil) {
-    int int_content_length = str_to_int(content_length, "Invalid content length");
-    if (int_content_length < 0) RAISE_BAD_REQUEST("Invalid body content length");
-    parser->body_read_mode = parser->body_left = int_content_length;
-    parser->request_completed = 0;
+  if (parser->framing & FRAMING_INVALID_CONTENT_LENGTH)
+    RAISE_PARSE_ERROR(parser, ERR_BODY, "Invalid content length");
+
+  if (parser->content_length >= 0) {
+    parser->body_read_mode = parser->body_left = parser->content_length;
+    if (parser->content_length)
+      parser->request_completed = 0;
+    else
+      set_request_completed(parser);
     return;
   }
 
-  VALUE transfer_encoding = rb_hash_aref(parser->headers, STR_transfer_encoding);
-  if (chunked_encoding_p(transfer_encoding)) {
+  if (parser->framing & FRAMING_CHUNKED) {
     parser->body_read_mode = BODY_READ_MODE_CHUNKED;
     parser->request_completed = 0;
     return;
   }
-  parser->request_completed = 1;
+  set_request_completed(parser);
 
 }
 
-static inline VALUE read_body(VALUE self, int read_entire_body, int buffered_only) {
+static inline VALUE read_body(VALUE self, VALUE body, int read_entire_body, int buffered_only) {
   Parser_t *parser;
   GetParser(self, parser);
 
@@ -1097,9 +2821,21 @@ static inline VALUE read_body(VALUE self, int read_entire_body, int buffered_onl
     detect_body_read_mode(parser);
 
   if (parser->body_read_mode == BODY_READ_MODE_CHUNKED)
-    return read_body_with_chunked_encoding(parser, read_entire_body, buffered_only);
+    return read_body_with_chunked_encoding(parser, body, read_entire_body, buffered_only);
   else
-    return read_body_with_content_length(parser, read_entire_body, buffered_only);
+    return read_body_with_content_length(parser, body, read_entire_body, buffered_only);
+}
+
+// Reads the body into the given buffer, replacing its content. Returns the
+// number of bytes read, or nil if no body data was read.
+static inline VALUE read_body_into(VALUE self, VALUE buf, int read_entire_body, int buffered_only) {
+  StringValue(buf);
+  rb_str_modify(buf);
+  rb_str_set_len(buf, 0);
+
+  read_body(self, buf, read_entire_body, buffered_only);
+  long len = RSTRING_LEN(buf);
+  return len ? LONG2FIX(len) : Qnil;
 }
 
 /* call-seq: parser.read_body -> body
@@ -1107,7 +2843,7 @@ static inline VALUE read_body(VALUE self, int read_entire_body, int buffered_onl
  * Reads an HTTP request/response body from the associated IO instance.
  */
 VALUE Parser_read_body(VALUE self) {
-  return read_body(self, 1, 0);
+  return read_body(self, Qnil, 1, 0);
 }
 
 /* call-seq: parser.read_body_chunk(buffered_only) -> chunk
@@ -1117,18 +2853,44 @@ VALUE Parser_read_body(VALUE self) {
  * reading from the associated IO instance.
  */
 VALUE Parser_read_body_chunk(VALUE self, VALUE buffered_only) {
-  return read_body(self, 0, buffered_only == Qtrue);
+  return read_body(self, Qnil, 0, buffered_only == Qtrue);
+}
+
+/* call-seq: parser.read_body_into(buf) -> byte_count
+ *
+ * Reads an HTTP request/response body from the associated IO instance into the
+ * given string, replacing its content. The string is grown only as needed.
+ * Returns the number of bytes read, or nil if no body was read.
+ */
+VALUE Parser_read_body_into(VALUE self, VALUE buf) {
+  return read_body_into(self, buf, 1, 0);
+}
+
+/* call-seq: parser.read_body_chunk_into(buf, buffered_only) -> byte_count
+ *
+ * Reads a single body chunk into the given string, replacing its content. For
+ * bodies with a content length, the data read is limited to the string's
+ * capacity (or 4096 bytes, whichever is greater), so a preallocated string (e.g. `String.new(capacity: 65536)`) can
+ * be used to stream a body through a fixed buffer. Returns the number of bytes
+ * read, or nil if no more chunks are available.
+ */
+VALUE Parser_read_body_chunk_into(VALUE self, VALUE buf, VALUE buffered_only) {
+  return read_body_into(self, buf, 0, buffered_only == Qtrue);
 }
 
 /* call-seq: parser.splice_body_to(dest)
  *
  * Splices the HTTP request/response body from the associated IO instance to
- * `dest`.
+ * `dest`. If `dest` is an IO instance (and does not respond to
+ * `#__write_method__`), the body is written directly to its file descriptor,
+ * using splice(2) on Linux when the associated IO is also an IO instance.
  */
 VALUE Parser_splice_body_to(VALUE self, VALUE dest) {
   Parser_t *parser;
   GetParser(self, parser);
   enum write_method method = detect_write_method(dest);
+  // flush any data buffered by the IO before writing to its fd
+  if (method == WM_NATIVE || method == WM_NATIVE_BLOCKING) rb_io_flush(dest);
 
   if (parser->body_read_mode == BODY_READ_MODE_UNKNOWN)
     detect_body_read_mode(parser);
@@ -1156,42 +2918,830 @@ VALUE Parser_complete_p(VALUE self) {
   return parser->request_completed ? Qtrue : Qfalse;
 }
 
+#define STATS_COUNTER_COUNT 9
+
+static ID stats_ids[STATS_COUNTER_COUNT];
+static ID stats_error_ids[ERR_COUNT];
+static ID stats_errors_id;
+
+static VALUE stats_to_hash(parser_stats_t *stats) {
+  const uint64_t values[] = {
+    stats->reads, stats->bytes_read, stats->buffer_refills, stats->buffer_trims,
+    stats->buffer_bytes_moved, stats->buffer_high_water, stats->requests,
+    stats->body_bytes_read, stats->body_bytes_spliced
+  };
+  VALUE hash = rb_hash_new();
+  VALUE errors = rb_hash_new();
+
+  for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+    rb_hash_aset(hash, ID2SYM(stats_ids[i]), ULL2NUM(values[i]));
+  for (int i = 0; i < ERR_COUNT; i++)
+    rb_hash_aset(errors, ID2SYM(stats_error_ids[i]), ULL2NUM(stats->errors[i]));
+  rb_hash_aset(hash, ID2SYM(stats_errors_id), errors);
+  return hash;
+}
+
+/* call-seq: parser.stats -> hash
+ *
+ * Returns the parser's instrumentation counters:
+ *
+ * - `:reads`: number of reads from the parser's IO (or pushed segments).
+ * - `:bytes_read`: number of bytes read.
+ * - `:buffer_refills`: number of reads into the header buffer.
+ * - `:buffer_trims`: number of buffer trims that moved leftover data.
+ * - `:buffer_bytes_moved`: number of bytes moved by buffer trims.
+ * - `:buffer_high_water`: maximum buffer capacity.
+ * - `:requests`: number of messages parsed.
+ * - `:body_bytes_read`: number of body bytes read.
+ * - `:body_bytes_spliced`: number of body bytes spliced or copied to another IO.
+ * - `:errors`: a hash of error counts by kind (`:start_line`, `:header`,
+ *   `:body`, `:incomplete_body`).
+ *
+ * The counters are always on, and cost a few integer additions per read.
+ */
+VALUE Parser_stats(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  return stats_to_hash(&parser->stats);
+}
+
+/* call-seq: H1P.stats -> hash
+ *
+ * Returns the instrumentation counters aggregated across all parsers, in the
+ * same format as `Parser#stats`. The `:buffer_high_water` entry holds the
+ * maximum buffer capacity of any parser.
+ */
+VALUE H1P_stats(VALUE self) {
+  return stats_to_hash(&h1p_stats);
+}
+
+static inline VALUE timestamp_to_num(uint64_t ts) {
+  return ts ? DBL2NUM((double)ts / 1e9) : Qnil;
+}
+
+/* call-seq: parser.timings -> hash or nil
+ *
+ * Returns the timestamps recorded for the current message, if the parser was
+ * created with `timings: true`:
+ *
+ * - `:first_byte`: when the first byte of the message was seen. If the message
+ *   was already buffered (for example with pipelined requests) this is the
+ *   time parsing of the message started.
+ * - `:headers_done`: when the headers were parsed.
+ * - `:body_done`: when the body was completely read.
+ *
+ * Timestamps are in seconds, on the same clock as
+ * `Process.clock_gettime(Process::CLOCK_MONOTONIC)`, and are nil for events that
+ * did not yet happen. Returns nil if timings are not enabled.
+ */
+VALUE Parser_timings(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  if (!parser->timings) return Qnil;
+
+  if (parser->headers != Qnil && parser->body_read_mode == BODY_READ_MODE_UNKNOWN)
+    detect_body_read_mode(parser);
+
+  VALUE hash = rb_hash_new();
+  rb_hash_aset(hash, ID2SYM(ID_first_byte), timestamp_to_num(parser->ts_first_byte));
+  rb_hash_aset(hash, ID2SYM(ID_headers_done), timestamp_to_num(parser->ts_headers_done));
+  rb_hash_aset(hash, ID2SYM(ID_body_done), timestamp_to_num(parser->ts_body_done));
+  return hash;
+}
+
+/* call-seq: parser.content_length -> integer or nil
+ *
+ * Returns the value of the Content-Length header of the current message, or
+ * nil if not specified. Raises `H1P::Error` if the header is invalid.
+ */
+VALUE Parser_content_length(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  if (parser->framing & FRAMING_INVALID_CONTENT_LENGTH)
+    RAISE_PARSE_ERROR(parser, ERR_BODY, "Invalid content length");
+  return parser->content_length >= 0 ? LL2NUM(parser->content_length) : Qnil;
+}
+
+/* call-seq: parser.trailers -> hash or nil
+ *
+ * Returns the trailer fields received after the last chunk of a chunked body,
+ * or nil if none were received. Trailer fields are available once the body has
+ * been fully read.
+ */
+VALUE Parser_trailers(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  return parser->trailers;
+}
+
+/* call-seq: parser.chunked? -> bool
+ *
+ * Returns true if the body of the current message uses chunked transfer
+ * encoding.
+ */
+VALUE Parser_chunked_p(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  return (parser->framing & FRAMING_CHUNKED) ? Qtrue : Qfalse;
+}
+
+/* call-seq: parser.keep_alive? -> bool
+ *
+ * Returns true if the connection may be reused after the current message,
+ * according to the protocol version and the Connection header.
+ */
+VALUE Parser_keep_alive_p(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  int framing = parser->framing;
+  if (framing & FRAMING_CONNECTION_CLOSE) return Qfalse;
+  if (framing & (FRAMING_HTTP_1_1 | FRAMING_CONNECTION_KEEP_ALIVE)) return Qtrue;
+  return Qfalse;
+}
+
+/* call-seq: parser.upgrade? -> bool
+ *
+ * Returns true if the current message requests a protocol upgrade, i.e. it
+ * has an Upgrade header, and the Connection header includes "upgrade".
+ */
+VALUE Parser_upgrade_p(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  int mask = FRAMING_UPGRADE | FRAMING_CONNECTION_UPGRADE;
+  return ((parser->framing & mask) == mask) ? Qtrue : Qfalse;
+}
+
+/* call-seq: parser.expect_continue? -> bool
+ *
+ * Returns true if the current message has an `Expect: 100-continue` header.
+ */
+VALUE Parser_expect_continue_p(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  return (parser->framing & FRAMING_EXPECT_CONTINUE) ? Qtrue : Qfalse;
+}
+
+// State of the last parsed message, saved before parsing a buffered message and
+// restored if the message is left in the buffer, so that it is not counted
+// twice once it is parsed again.
+typedef struct message_state {
+  VALUE    headers;
+  VALUE    trailers;
+  int      framing;
+  int64_t  content_length;
+  int64_t  body_read_mode;
+  int64_t  body_left;
+  int      request_completed;
+  int64_t  current_request_rx;
+  int      read_size;
+  int      header_count_avg;
+  uint64_t requests;
+  uint64_t ts_first_byte;
+  uint64_t ts_headers_done;
+  uint64_t ts_body_done;
+} message_state_t;
+
+static inline void message_state_save(Parser_t *parser, message_state_t *state) {
+  *state = (message_state_t){
+    parser->headers, parser->trailers, parser->framing, parser->content_length,
+    parser->body_read_mode, parser->body_left, parser->request_completed,
+    parser->current_request_rx, parser->read_size, parser->header_count_avg,
+    parser->stats.requests, parser->ts_first_byte, parser->ts_headers_done,
+    parser->ts_body_done
+  };
+}
+
+static inline void message_state_restore(Parser_t *parser, message_state_t *state) {
+  parser->headers = state->headers;
+  parser->trailers = state->trailers;
+  parser->framing = state->framing;
+  parser->content_length = state->content_length;
+  parser->body_read_mode = state->body_read_mode;
+  parser->body_left = state->body_left;
+  parser->request_completed = state->request_completed;
+  parser->current_request_rx = state->current_request_rx;
+  parser->read_size = state->read_size;
+  parser->header_count_avg = state->header_count_avg;
+  h1p_stats.requests -= parser->stats.requests - state->requests;
+  parser->stats.requests = state->requests;
+  parser->ts_first_byte = state->ts_first_byte;
+  parser->ts_headers_done = state->ts_headers_done;
+  parser->ts_body_done = state->ts_body_done;
+}
+
+static VALUE Parser_parse_buffered_requests_safe(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  VALUE requests = rb_ary_new();
+
+  // the body of the current message has not been read yet
+  if (parser->headers != Qnil) {
+    if (parser->body_read_mode == BODY_READ_MODE_UNKNOWN)
+      detect_body_read_mode(parser);
+    if (!parser->request_completed) return requests;
+  }
+
+  message_state_t state;
+  while (BUFFER_POS(parser) < BUFFER_LEN(parser)) {
+    message_state_save(parser, &state);
+    parser->headers = Qnil;
+    VALUE headers = Parser_parse_headers_safe(self);
+    if (headers == Qnil) goto rewind;
+
+    detect_body_read_mode(parser);
+    if (parser->body_read_mode == BODY_READ_MODE_CHUNKED) goto rewind;
+
+    VALUE body = Qnil;
+    if (parser->body_left > 0) {
+      if (parser->body_left > BUFFER_LEN(parser) - BUFFER_POS(parser)) goto rewind;
+      body = read_body_with_content_length(parser, Qnil, 1, 1);
+      set_rx(parser, parser->current_request_rx);
+    }
+    set_request_completed(parser);
+    rb_ary_push(requests, rb_assoc_new(headers, body));
+    RB_GC_GUARD(body);
+  }
+  return requests;
+rewind:
+  // leave the incomplete (or chunked) request in the buffer
+  BUFFER_POS(parser) = parser->request_pos;
+  message_state_restore(parser, &state);
+  RB_GC_GUARD(state.headers);
+  RB_GC_GUARD(state.trailers);
+  return requests;
+}
+
+static VALUE Parser_parse_buffered_requests_rescued(VALUE self) {
+  return rb_rescue2(
+    Parser_parse_buffered_requests_safe, self,
+    Parser_parse_headers_rescue, self,
+    eArgumentError, (VALUE)0
+  );
+}
+
+static VALUE Parser_parse_buffered_requests_ensure(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  parser->buffered_only = 0;
+  return Qnil;
+}
+
+/* call-seq: parser.parse_buffered_requests -> [[headers, body], ...]
+ *
+ * Parses all complete messages already present in the parser's buffer, without
+ * reading from the associated IO instance. Returns an array of
+ * `[headers, body]` pairs, where `body` is `nil` if the message has no body.
+ * Parsing stops at the first message that is incomplete or has a chunked body,
+ * which is left in the buffer to be read using `#parse_headers`. An empty array
+ * is returned if no complete message is buffered.
+ */
+VALUE Parser_parse_buffered_requests(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+
+  parser->buffered_only = 1;
+  return rb_ensure(
+    Parser_parse_buffered_requests_rescued, self,
+    Parser_parse_buffered_requests_ensure, self
+  );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Push mode
+
+#define MAX_START_LINE_LENGTH   (MAX_METHOD_LENGTH + MAX_PATH_LENGTH + MAX_STATUS_MESSAGE_LENGTH + 16)
+
+// Discards consumed data from the buffer. While parsing headers, the data from
+// the start of the message is kept.
+static inline void push_buffer_trim(Parser_t *parser) {
+  int base = (parser->push_state == PUSH_HEADERS) ? parser->request_pos : parser->buf_pos;
+  int len = parser->buf_len;
+  int left = len - base;
+
+  if (!base) return;
+  if (left && (len < BUFFER_TRIM_MIN_LEN || base < BUFFER_TRIM_MIN_POS || left >= base)) return;
+
+  if (left) {
+    memmove(parser->buf_ptr, parser->buf_ptr + base, left);
+    STATS_ADD(parser, buffer_trims, 1);
+    STATS_ADD(parser, buffer_bytes_moved, left);
+  }
+  rb_str_set_len(parser->buffer, left);
+  parser->buf_len = left;
+  parser->buf_pos -= base;
+  parser->scan_pos -= base;
+  parser->request_pos -= base;
+  if (!left) buffer_shrink(parser);
+}
+
+// Parses the message start line and headers, one complete line at a time. The
+// search for the end of the current line resumes from where it stopped, so the
+// bytes of a partial line are not scanned again when more data arrives. Once a
+// line is complete, it is parsed in a single pass by the regular tokenizers.
+// Returns 1 when the headers are complete, or 0 if more data is needed.
+static int push_parse_headers(Parser_t *parser) {
+  if (parser->scan_pos < BUFFER_POS(parser)) parser->scan_pos = BUFFER_POS(parser);
+  while (1) {
+    int pos = BUFFER_POS(parser);
+    char *lf = memchr(BUFFER_PTR(parser, parser->scan_pos), '\n', BUFFER_LEN(parser) - parser->scan_pos);
+    if (!lf) {
+      int max = (parser->push_state == PUSH_START_LINE) ? MAX_START_LINE_LENGTH : MAX_HEADER_LINE_LENGTH;
+      if (BUFFER_LEN(parser) - pos > max) RAISE_PARSE_ERROR(parser, ERR_HEADER, "Line too long");
+      parser->scan_pos = BUFFER_LEN(parser);
+      return 0;
+    }
+
+    int line_end = lf - parser->buf_ptr + 1;
+    int line_len = line_end - pos;
+    int empty = (line_len == 1) || (line_len == 2 && BUFFER_AT(parser, pos) == '\r');
+    // The tokenizers look one byte past the end of a line, except for the
+    // empty line ending the headers.
+    if (line_end == BUFFER_LEN(parser) && !(empty && parser->push_state == PUSH_HEADERS)) {
+      parser->scan_pos = line_end - 1;
+      return 0;
+    }
+    parser->scan_pos = line_end;
+
+    if (parser->push_state == PUSH_START_LINE) {
+      parser->headers = Qnil;
+      parse_headers_begin(parser);
+      parser->push_header_count = 0;
+      if (!parse_start_line(parser)) RAISE_PARSE_ERROR(parser, ERR_START_LINE, "Invalid start line");
+      parser->push_state = PUSH_HEADERS;
+      continue;
+    }
+
+    if (parser->push_header_count > MAX_HEADER_COUNT) RAISE_PARSE_ERROR(parser, ERR_HEADER, "Too many headers");
+    switch (parse_header(parser)) {
+      case -1:
+        parse_headers_end(parser, parser->push_header_count);
+        return 1;
+      case 0:
+        RAISE_PARSE_ERROR(parser, ERR_HEADER, "Invalid header");
+    }
+    parser->push_header_count++;
+  }
+}
+
+static inline void push_message_done(Parser_t *parser) {
+  set_request_completed(parser);
+  parser->push_state = PUSH_START_LINE;
+  if (parser->body_read_mode != 0) set_rx(parser, parser->current_request_rx);
+}
+
+// Returns a string with up to body_left bytes of body data from the buffer.
+static inline VALUE push_body_data(Parser_t *parser) {
+  int available = BUFFER_LEN(parser) - BUFFER_POS(parser);
+  if (available > parser->body_left) available = parser->body_left;
+
+  VALUE data = rb_str_new(BUFFER_PTR(parser, BUFFER_POS(parser)), available);
+  BUFFER_POS(parser) += available;
+  parser->current_request_rx += available;
+  STATS_ADD(parser, body_bytes_read, available);
+  parser->body_left -= available;
+  return data;
+}
+
+// Runs the push mode state machine over the buffered data, until a message
+// head or body data is available, or all buffered data is consumed.
+static VALUE push_parse(Parser_t *parser) {
+  while (1) {
+    switch (parser->push_state) {
+      case PUSH_START_LINE:
+      case PUSH_HEADERS:
+        if (!push_parse_headers(parser)) return SYM_need_more;
+
+        detect_body_read_mode(parser);
+        if (parser->body_read_mode == BODY_READ_MODE_CHUNKED)
+          parser->push_state = PUSH_CHUNK_SIZE;
+        else if (parser->body_left > 0)
+          parser->push_state = PUSH_BODY;
+        else
+          push_message_done(parser);
+        return parser->headers;
+
+      case PUSH_BODY:
+        if (BUFFER_POS(parser) == BUFFER_LEN(parser)) return SYM_need_more;
+        VALUE body_data = push_body_data(parser);
+        if (!parser->body_left) push_message_done(parser);
+        return body_data;
+
+      case PUSH_CHUNK_SIZE:
+      case PUSH_TRAILERS: {
+        int end = 0;
+        int len = (parser->push_state == PUSH_CHUNK_SIZE) ?
+          chunk_header_scan(BUFFER_PTR(parser, BUFFER_POS(parser)), BUFFER_LEN(parser) - BUFFER_POS(parser), &parser->body_left) :
+          trailer_line_parse(parser, BUFFER_PTR(parser, BUFFER_POS(parser)), BUFFER_LEN(parser) - BUFFER_POS(parser), &end);
+        if (len < 0)
+          RAISE_PARSE_ERROR(parser, ERR_BODY, parser->push_state == PUSH_CHUNK_SIZE ? "Invalid chunk size" : "Invalid trailer");
+        if (!len) return SYM_need_more;
+        BUFFER_POS(parser) += len;
+        parser->current_request_rx += len;
+
+        if (parser->push_state == PUSH_TRAILERS) {
+          if (end) push_message_done(parser);
+        }
+        // a zero size chunk marks the end of the body
+        else
+          parser->push_state = parser->body_left ? PUSH_CHUNK_DATA : PUSH_TRAILERS;
+        continue;
+      }
+
+      case PUSH_CHUNK_DATA:
+        if (BUFFER_POS(parser) == BUFFER_LEN(parser)) return SYM_need_more;
+        VALUE chunk_data = push_body_data(parser);
+        if (!parser->body_left) {
+          parser->push_state = PUSH_CR;
+          parser->push_next_state = PUSH_CHUNK_SIZE;
+        }
+        return chunk_data;
+
+      case PUSH_CR:
+      case PUSH_LF:
+        if (BUFFER_POS(parser) == BUFFER_LEN(parser)) return SYM_need_more;
+        char c = BUFFER_CUR(parser);
+        if (c != '\n' && (c != '\r' || parser->push_state != PUSH_CR))
+          RAISE_PARSE_ERROR(parser, ERR_BODY, "Invalid chunk");
+        BUFFER_POS(parser)++;
+        parser->current_request_rx++;
+        parser->push_state = (c == '\r') ? PUSH_LF : parser->push_next_state;
+        continue;
+    }
+  }
+}
+
+static VALUE Parser_push_safe(VALUE self) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  VALUE ret = push_parse(parser);
+  if (ret == SYM_need_more)
+    parser_buffer_release(parser, parser->push_state == PUSH_HEADERS ? parser->request_pos : parser->buf_pos);
+  return ret;
+}
+
+/* call-seq: parser << data -> :need_more, headers or body data
+ *
+ * Feeds data to a push mode parser (created with a nil IO), and returns the
+ * next parsing event: the headers once a complete message head has been
+ * parsed, a string with body data (for chunked messages, the data of a single
+ * chunk, or part of it), or `:need_more` when more data is needed. Since a
+ * single segment of data may contain more than one event, the parser should be
+ * fed an empty string to get further events until `:need_more` is returned.
+ * Use `#complete?` to check whether the body of the current message has been
+ * fully read.
+ *
+ * The parser state is kept between calls. Completed lines are tokenized once,
+ * and incomplete data is not re-parsed when more data is fed, regardless of how
+ * the message is fragmented.
+ */
+VALUE Parser_push(VALUE self, VALUE data) {
+  Parser_t *parser;
+  GetParser(self, parser);
+  if (!parser->push) rb_raise(rb_eRuntimeError, "Parser is not in push mode");
+
+  StringValue(data);
+  push_buffer_trim(parser);
+  if (RSTRING_LEN(data)) {
+    long size = RSTRING_LEN(data);
+    // buffer offsets are int
+    if (size > INT_MAX - BUFFER_LEN(parser)) rb_raise(eArgumentError, "Pushed data too large");
+    parser_buffer_acquire(parser, size > parser->read_size ? (int)size : parser->read_size);
+    str_append_from_buffer(parser->buffer, RSTRING_PTR(data), size);
+    STATS_ADD(parser, reads, 1);
+    STATS_ADD(parser, bytes_read, RSTRING_LEN(data));
+    STATS_MAX(parser, buffer_high_water, rb_str_capacity(parser->buffer));
+  }
+  parser->buf_ptr = RSTRING_PTR(parser->buffer);
+  parser->buf_len = RSTRING_LEN(parser->buffer);
+  // In push mode the timestamps for a completed message are kept until the
+  // next call to #<<, so they can be retrieved after the last event.
+  if (parser->push_state == PUSH_START_LINE && parser->ts_body_done)
+    timings_message_start(parser);
+  else if (RSTRING_LEN(data))
+    timings_data_received(parser);
+  RB_GC_GUARD(data);
+
+  return rb_rescue2(
+    Parser_push_safe, self,
+    Parser_parse_headers_rescue, self,
+    eArgumentError, (VALUE)0
+  );
+}
+
 typedef struct send_response_ctx {
   VALUE io;
+  int native; // 1 for non-blocking IO instances, 0 for blocking, -1 otherwise
+  VALUE prefix; // preformatted data to be written before the buffer, or nil
   VALUE buffer;
   char *buffer_ptr;
   unsigned int buffer_len;
-  unsigned int total_written;
+  size_t total_written;
 } send_response_ctx;
 
 #define MAX_RESPONSE_BUFFER_SIZE 65536
 
-void send_response_flush_buffer(send_response_ctx *ctx) {
-  if (!ctx->buffer_len) return;
+#define RESPONSE_BUFFER_POOL_SIZE 16
+
+// Free response staging buffers. A buffer is taken out of the pool while in
+// use, so that concurrent (or nested) calls from different threads or fibers
+// get separate buffers. Responses are only sent from the main Ractor, so the
+// pool is protected by the GVL.
+static VALUE response_buffer_pool = Qnil;
+
+static inline VALUE response_buffer_acquire(void) {
+  VALUE buffer = rb_ary_pop(response_buffer_pool);
+  if (buffer == Qnil) {
+    buffer = rb_str_new_literal("");
+    rb_str_modify_expand(buffer, MAX_RESPONSE_BUFFER_SIZE);
+  }
+  return buffer;
+}
+
+static inline void response_buffer_release(VALUE buffer) {
+  if (RARRAY_LEN(response_buffer_pool) >= RESPONSE_BUFFER_POOL_SIZE) return;
+
+  rb_str_set_len(buffer, 0);
+  rb_ary_push(response_buffer_pool, buffer);
+}
 
+// Sets up the response context. Data for IO instances is written directly to
+// the fd, using a pooled staging buffer. For other targets a new buffer is
+// allocated, since it is passed to io.write, which might hold on to it.
+static inline void send_response_ctx_init(send_response_ctx *ctx, VALUE io) {
+  ctx->io = io;
+  ctx->native = io == Qnil ? -1 : native_io_nonblock_p(io);
+  ctx->prefix = Qnil;
+  if (ctx->native != -1) {
+    rb_io_flush(io);
+    ctx->buffer = response_buffer_acquire();
+  }
+  else {
+    ctx->buffer = rb_str_new_literal("");
+    rb_str_modify_expand(ctx->buffer, MAX_RESPONSE_BUFFER_SIZE);
+  }
+  ctx->buffer_ptr = RSTRING_PTR(ctx->buffer);
+  ctx->buffer_len = 0;
+  ctx->total_written = 0;
+}
+
+static inline void send_response_ctx_done(send_response_ctx *ctx) {
+  if (ctx->native != -1) response_buffer_release(ctx->buffer);
+}
+
+// Writes the prefix (if set), the staged data and the given string (if not
+// nil) to the io, using a single writev(2) call. Other targets get a single
+// io.write call with a single string argument.
+void send_response_flush_buffer_with(send_response_ctx *ctx, VALUE str) {
+  if (!ctx->buffer_len && str == Qnil && ctx->prefix == Qnil) return;
+  if (ctx->io == Qnil) rb_raise(eArgumentError, "Response headers too big");
+
+  VALUE prefix = ctx->prefix;
+  ctx->prefix = Qnil;
   rb_str_set_len(ctx->buffer, ctx->buffer_len);
-  VALUE written = rb_funcall(ctx->io, ID_write, 1, ctx->buffer);
-  ctx->total_written += NUM2INT(written);
-  
+  VALUE parts[3];
+  int count = 0;
+  if (prefix != Qnil) parts[count++] = prefix;
+  parts[count++] = ctx->buffer;
+  if (str != Qnil) parts[count++] = str;
+
+#ifdef H1P_NATIVE_IO
+  if (ctx->native != -1) {
+    struct iovec iov[3];
+    for (int i = 0; i < count; i++)
+      iov[i] = (struct iovec){RSTRING_PTR(parts[i]), RSTRING_LEN(parts[i])};
+    // the staging buffer is owned by the context, and the prefix is frozen
+    ctx->total_written += io_native_writev(ctx->io, !ctx->native, iov, count, &str, str != Qnil);
+  }
+  else
+#endif
+  {
+    VALUE data = ctx->buffer;
+    if (count > 1) {
+      long len = 0;
+      for (int i = 0; i < count; i++) len += RSTRING_LEN(parts[i]);
+      data = rb_str_buf_new(len);
+      for (int i = 0; i < count; i++) rb_str_buf_append(data, parts[i]);
+    }
+    VALUE written = rb_funcall(ctx->io, ID_write, 1, data);
+    ctx->total_written += NUM2LONG(written);
+    RB_GC_GUARD(data);
+  }
+
   rb_str_set_len(ctx->buffer, 0);
   ctx->buffer_len = 0;
+  RB_GC_GUARD(prefix);
+  RB_GC_GUARD(str);
+}
+
+void send_response_flush_buffer(send_response_ctx *ctx) {
+  send_response_flush_buffer_with(ctx, Qnil);
+}
+
+#define HTTP_DATE_LEN 29 // "Sun, 06 Nov 1994 08:49:37 GMT"
+
+// The formatted date is cached and reformatted at most once per second. Since
+// the cache may be accessed concurrently from multiple Ractors, it is guarded
+// by a sequence counter: the writer makes it odd while updating the cache, and
+// readers retry when the counter is odd or has changed while copying.
+static struct {
+  unsigned long seq;
+  time_t        time;
+  char          str[HTTP_DATE_LEN];
+} http_date_cache;
+
+static void format_http_date(char *buf, time_t time) {
+  static const char days[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+  static const char months[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  struct tm tm;
+  gmtime_r(&time, &tm);
+
+  char tmp[HTTP_DATE_LEN + 1];
+  snprintf(tmp, sizeof(tmp), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+    days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900,
+    tm.tm_hour, tm.tm_min, tm.tm_sec);
+  memcpy(buf, tmp, HTTP_DATE_LEN);
+}
+
+// Copies the current date formatted according to RFC 9110 into buf.
+static void http_date(char *buf) {
+  time_t now = time(NULL);
+
+  for (int attempt = 0; attempt < 3; attempt++) {
+    unsigned long seq = __atomic_load_n(&http_date_cache.seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) continue;
+
+    int hit = __atomic_load_n(&http_date_cache.time, __ATOMIC_RELAXED) == now;
+    if (hit) memcpy(buf, http_date_cache.str, HTTP_DATE_LEN);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&http_date_cache.seq, __ATOMIC_RELAXED) != seq) continue;
+    if (hit) return;
+
+    format_http_date(buf, now);
+    // update the cache, unless another writer got there first
+    if (__atomic_compare_exchange_n(&http_date_cache.seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&http_date_cache.time, now, __ATOMIC_RELAXED);
+      memcpy(http_date_cache.str, buf, HTTP_DATE_LEN);
+      __atomic_store_n(&http_date_cache.seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    return;
+  }
+  format_http_date(buf, now);
+}
+
+static void send_response_write_date_header(send_response_ctx *ctx) {
+  if (ctx->buffer_len + HTTP_DATE_LEN + 8 > MAX_RESPONSE_BUFFER_SIZE)
+    send_response_flush_buffer(ctx);
+
+  char *ptr = ctx->buffer_ptr + ctx->buffer_len;
+  memcpy(ptr, "Date: ", 6);
+  http_date(ptr + 6);
+  ptr[HTTP_DATE_LEN + 6] = '\r';
+  ptr[HTTP_DATE_LEN + 7] = '\n';
+  ctx->buffer_len += HTTP_DATE_LEN + 8;
+}
+
+static inline int date_kwarg(VALUE opts) {
+  if (opts == Qnil) return 0;
+
+  ID keys[1] = {ID_date};
+  VALUE values[1];
+  rb_get_kwargs(opts, keys, 0, 1, values);
+  return values[0] != Qundef && RTEST(values[0]);
+}
+
+/* call-seq: H1P.http_date -> string
+ *
+ * Returns the current date formatted for use in a Date header. The formatted
+ * date is cached, and is updated at most once per second.
+ */
+VALUE H1P_http_date(VALUE self) {
+  char buf[HTTP_DATE_LEN];
+  http_date(buf);
+  return rb_obj_freeze(rb_str_new(buf, HTTP_DATE_LEN));
+}
+
+#define STATUS_LINE(code, reason) [code - 100] = "HTTP/1.1 " #code " " reason "\r\n"
+
+// Preformatted status lines for integer statuses
+static const char *status_lines[500] = {
+  STATUS_LINE(100, "Continue"),
+  STATUS_LINE(101, "Switching Protocols"),
+  STATUS_LINE(102, "Processing"),
+  STATUS_LINE(103, "Early Hints"),
+  STATUS_LINE(200, "OK"),
+  STATUS_LINE(201, "Created"),
+  STATUS_LINE(202, "Accepted"),
+  STATUS_LINE(203, "Non-Authoritative Information"),
+  STATUS_LINE(204, "No Content"),
+  STATUS_LINE(205, "Reset Content"),
+  STATUS_LINE(206, "Partial Content"),
+  STATUS_LINE(207, "Multi-Status"),
+  STATUS_LINE(208, "Already Reported"),
+  STATUS_LINE(226, "IM Used"),
+  STATUS_LINE(300, "Multiple Choices"),
+  STATUS_LINE(301, "Moved Permanently"),
+  STATUS_LINE(302, "Found"),
+  STATUS_LINE(303, "See Other"),
+  STATUS_LINE(304, "Not Modified"),
+  STATUS_LINE(305, "Use Proxy"),
+  STATUS_LINE(307, "Temporary Redirect"),
+  STATUS_LINE(308, "Permanent Redirect"),
+  STATUS_LINE(400, "Bad Request"),
+  STATUS_LINE(401, "Unauthorized"),
+  STATUS_LINE(402, "Payment Required"),
+  STATUS_LINE(403, "Forbidden"),
+  STATUS_LINE(404, "Not Found"),
+  STATUS_LINE(405, "Method Not Allowed"),
+  STATUS_LINE(406, "Not Acceptable"),
+  STATUS_LINE(407, "Proxy Authentication Required"),
+  STATUS_LINE(408, "Request Timeout"),
+  STATUS_LINE(409, "Conflict"),
+  STATUS_LINE(410, "Gone"),
+  STATUS_LINE(411, "Length Required"),
+  STATUS_LINE(412, "Precondition Failed"),
+  STATUS_LINE(413, "Content Too Large"),
+  STATUS_LINE(414, "URI Too Long"),
+  STATUS_LINE(415, "Unsupported Media Type"),
+  STATUS_LINE(416, "Range Not Satisfiable"),
+  STATUS_LINE(417, "Expectation Failed"),
+  STATUS_LINE(418, "I'm a teapot"),
+  STATUS_LINE(421, "Misdirected Request"),
+  STATUS_LINE(422, "Unprocessable Content"),
+  STATUS_LINE(423, "Locked"),
+  STATUS_LINE(424, "Failed Dependency"),
+  STATUS_LINE(425, "Too Early"),
+  STATUS_LINE(426, "Upgrade Required"),
+  STATUS_LINE(428, "Precondition Required"),
+  STATUS_LINE(429, "Too Many Requests"),
+  STATUS_LINE(431, "Request Header Fields Too Large"),
+  STATUS_LINE(451, "Unavailable For Legal Reasons"),
+  STATUS_LINE(500, "Internal Server Error"),
+  STATUS_LINE(501, "Not Implemented"),
+  STATUS_LINE(502, "Bad Gateway"),
+  STATUS_LINE(503, "Service Unavailable"),
+  STATUS_LINE(504, "Gateway Timeout"),
+  STATUS_LINE(505, "HTTP Version Not Supported"),
+  STATUS_LINE(506, "Variant Also Negotiates"),
+  STATUS_LINE(507, "Insufficient Storage"),
+  STATUS_LINE(508, "Loop Detected"),
+  STATUS_LINE(510, "Not Extended"),
+  STATUS_LINE(511, "Network Authentication Required"),
+};
+
+#define STATUS_LINE_PROTOCOL_LEN 9 // "HTTP/1.1 "
+
+// Writes the status line for an integer status between 100 and 599. Unknown
+// statuses are written with an empty reason phrase.
+static void send_response_write_int_status_line(send_response_ctx *ctx, VALUE protocol, long code) {
+  const char *line = status_lines[code - 100];
+  char *ptr = ctx->buffer_ptr + ctx->buffer_len;
+  unsigned int len;
+  if (line && protocol == STR_pseudo_protocol_default) {
+    len = strlen(line);
+    memcpy(ptr, line, len);
+  }
+  else {
+    len = RSTRING_LEN(protocol);
+    memcpy(ptr, RSTRING_PTR(protocol), len);
+    if (line) {
+      unsigned int partlen = strlen(line) - STATUS_LINE_PROTOCOL_LEN;
+      ptr[len] = ' ';
+      memcpy(ptr + len + 1, line + STATUS_LINE_PROTOCOL_LEN, partlen);
+      len += partlen + 1;
+    }
+    else
+      len += sprintf(ptr + len, " %03ld \r\n", code);
+  }
+  ctx->buffer_len += len;
 }
 
 void send_response_write_status_line(send_response_ctx *ctx, VALUE protocol, VALUE status) {
-  char *ptr = ctx->buffer_ptr;
+  if (TYPE(protocol) != T_STRING) protocol = rb_funcall(protocol, ID_to_s, 0);
+  if (FIXNUM_P(status)) {
+    long code = FIX2LONG(status);
+    if (code >= 100 && code <= 599) {
+      send_response_write_int_status_line(ctx, protocol, code);
+      return;
+    }
+  }
+  // other statuses are written as is
+  if (TYPE(status) != T_STRING) status = rb_funcall(status, ID_to_s, 0);
+
+  char *ptr = ctx->buffer_ptr + ctx->buffer_len;
 
-  unsigned int partlen = RSTRING_LEN(protocol);
-  memcpy(ptr, RSTRING_PTR(protocol), partlen);
-  ctx->buffer_len += partlen;
-  ptr[ctx->buffer_len] = ' ';
-  ctx->buffer_len++;
+  unsigned int protocol_len = RSTRING_LEN(protocol);
+  memcpy(ptr, RSTRING_PTR(protocol), protocol_len);
+  ptr[protocol_len] = ' ';
+  ptr += protocol_len + 1;
 
-  ptr += ctx->buffer_len;
-  partlen = RSTRING_LEN(status);
-  memcpy(ptr, RSTRING_PTR(status), partlen);
-  ptr[partlen] = '\r';
-  ptr[partlen + 1] = '\n';
-  ctx->buffer_len += partlen + 2;
+  unsigned int status_len = RSTRING_LEN(status);
+  memcpy(ptr, RSTRING_PTR(status), status_len);
+  ptr[status_len] = '\r';
+  ptr[status_len + 1] = '\n';
+  ctx->buffer_len += protocol_len + status_len + 3;
 }
 
 inline static VALUE format_comma_separated_header_values(VALUE array) {
@@ -1237,23 +3787,19 @@ int send_response_write_header(VALUE key, VALUE val, VALUE arg) {
   return 0; // ST_CONTINUE
 }
 
-/* call-seq: H1P.send_response(io, headers, body = nil) -> total_written
+/* call-seq: H1P.send_response(io, headers, body = nil, date: false) -> total_written
  *
- * Sends an HTTP response with the given headers and body.
+ * Sends an HTTP response with the given headers and body. If `date` is true, a
+ * Date header with the current (cached) date is added.
  */
 VALUE H1P_send_response(int argc,VALUE *argv, VALUE self) {
-  if (argc < 2)
-    rb_raise(eArgumentError, "(wrong number of arguments (expected 2 or more))");
-
-  VALUE io = argv[0];
-  VALUE headers = argv[1];
-  VALUE body = argc >= 3 ? argv[2] : Qnil;
-  VALUE buffer = rb_str_new_literal("");
-  rb_str_modify_expand(buffer, MAX_RESPONSE_BUFFER_SIZE);
-  send_response_ctx ctx = {io, buffer, RSTRING_PTR(buffer), 0, 0};
+  VALUE io, headers, body, opts;
+  rb_scan_args(argc, argv, "21:", &io, &headers, &body, &opts);
+  int date = date_kwarg(opts);
+  send_response_ctx ctx;
+  send_response_ctx_init(&ctx, io);
 
-  char *bodyptr = 0;
-  unsigned int bodylen = 0;
+  long bodylen = 0;
 
   VALUE protocol = rb_hash_aref(headers, STR_pseudo_protocol);
   if (protocol == Qnil) protocol = STR_pseudo_protocol_default;
@@ -1264,40 +3810,350 @@ VALUE H1P_send_response(int argc,VALUE *argv, VALUE self) {
   if (body != Qnil) {
     if (TYPE(body) != T_STRING) body = rb_funcall(body, ID_to_s, 0);
 
-    bodyptr = RSTRING_PTR(body);
     bodylen = RSTRING_LEN(body);
-    // rb_hash_aset(headers, STR_content_length_capitalized, INT2FIX(bodylen));
   }
 
   rb_hash_foreach(headers, send_response_write_header, (VALUE)&ctx);
-  send_response_write_header(STR_content_length_capitalized, INT2FIX(bodylen), (VALUE)&ctx);
+  if (date) send_response_write_date_header(&ctx);
+  send_response_write_header(STR_content_length_capitalized, LONG2FIX(bodylen), (VALUE)&ctx);
 
   char *endptr = ctx.buffer_ptr + ctx.buffer_len;
   endptr[0] = '\r';
   endptr[1] = '\n';
   ctx.buffer_len += 2;
 
-  if (body != Qnil) {
-    while (bodylen > 0) {
-      unsigned int chunklen = bodylen;
-      if (chunklen > MAX_RESPONSE_BUFFER_SIZE) chunklen = MAX_RESPONSE_BUFFER_SIZE;
-      
-      if (ctx.buffer_len + chunklen > MAX_RESPONSE_BUFFER_SIZE)
-        send_response_flush_buffer(&ctx);
-
-      memcpy(ctx.buffer_ptr + ctx.buffer_len, bodyptr, chunklen);
-      ctx.buffer_len += chunklen;
-      bodyptr += chunklen;
-      bodylen -= chunklen;
+  // the body is written along with the headers, without copying it
+  send_response_flush_buffer_with(&ctx, bodylen ? body : Qnil);
+  send_response_ctx_done(&ctx);
+
+  RB_GC_GUARD(body);
+  RB_GC_GUARD(ctx.buffer);
+  return SIZET2NUM(ctx.total_written);
+}
+
+// Parses a single byte range ("bytes=start-end", "bytes=start-" or
+// "bytes=-suffix") for an entity of the given size. Returns 1 if the range is
+// satisfiable, setting *start and *len, 0 if it is unsatisfiable, or -1 if the
+// range is malformed or specifies multiple ranges, in which case it should be
+// ignored (RFC 9110, section 14.2).
+static int parse_byte_range(VALUE range, off_t size, off_t *start, off_t *len) {
+  const char *ptr = RSTRING_PTR(range);
+  const char *end = ptr + RSTRING_LEN(range);
+  off_t first = -1, last = -1;
+
+  if (end - ptr < 6 || strncasecmp(ptr, "bytes=", 6)) return -1;
+  ptr += 6;
+  while (ptr < end && *ptr == ' ') ptr++;
+
+  #define PARSE_OFFSET(v) { \
+    int digits = 0; \
+    v = 0; \
+    while (ptr < end && *ptr >= '0' && *ptr <= '9') { \
+      if (++digits > 18) return -1; \
+      v = v * 10 + (*ptr++ - '0'); \
+    } \
+    if (!digits) v = -1; \
+  }
+
+  PARSE_OFFSET(first);
+  if (ptr == end || *ptr++ != '-') return -1;
+  PARSE_OFFSET(last);
+  #undef PARSE_OFFSET
+
+  while (ptr < end && *ptr == ' ') ptr++;
+  if (ptr != end) return -1;
+
+  if (first == -1) {
+    // suffix range
+    if (last == -1) return -1;
+    if (last == 0 || size == 0) return 0;
+    if (last > size) last = size;
+    *start = size - last;
+    *len = last;
+    return 1;
+  }
+  if (last != -1 && last < first) return -1;
+  if (first >= size) return 0;
+  if (last == -1 || last >= size) last = size - 1;
+  *start = first;
+  *len = last - first + 1;
+  return 1;
+}
+
+#ifdef H1P_NATIVE_SENDFILE
+// Sends len bytes of the file at the given offset using sendfile(2). Non-blocking
+// fds are waited on for writability, blocking fds are written to with the GVL
+// released.
+static void io_native_sendfile(VALUE io, int blocking, int in_fd, off_t offset, off_t len) {
+  int out_fd = rb_io_descriptor(io);
+
+  while (len > 0) {
+    size_t count = len > SENDFILE_CHUNK_SIZE ? SENDFILE_CHUNK_SIZE : len;
+    native_io_args_t args = {OP_SENDFILE, in_fd, out_fd, NULL, count, 0, 0, &offset};
+    ssize_t n = native_io(&args, blocking);
+    if (n > 0) {
+      len -= n;
+      continue;
     }
-    RB_GC_GUARD(body);
+    if (n == 0) rb_raise(rb_eEOFError, "end of file reached");
+
+    int e = errno;
+    if (!rb_io_maybe_wait_writable(e, io, Qnil)) rb_syserr_fail(e, "sendfile");
   }
+}
+#endif
+
+// Sends len bytes of the file at the given offset through the response buffer.
+static void send_file_buffered(send_response_ctx *ctx, int in_fd, off_t offset, off_t len) {
+  while (len > 0) {
+    if (ctx->buffer_len == MAX_RESPONSE_BUFFER_SIZE) send_response_flush_buffer(ctx);
+
+    size_t count = MAX_RESPONSE_BUFFER_SIZE - ctx->buffer_len;
+    if ((off_t)count > len) count = len;
+    ssize_t n = pread(in_fd, ctx->buffer_ptr + ctx->buffer_len, count, offset);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      rb_sys_fail("pread");
+    }
+    if (n == 0) rb_raise(rb_eEOFError, "end of file reached");
 
-  send_response_flush_buffer(&ctx);
+    ctx->buffer_len += n;
+    offset += n;
+    len -= n;
+  }
+  send_response_flush_buffer(ctx);
+}
 
-  RB_GC_GUARD(buffer);
+/* call-seq: H1P.send_file_response(io, headers, file, offset: nil, length: nil, range: nil) -> total_written
+ *
+ * Sends an HTTP response with the given headers, with the content of the given
+ * file as the response body. The `offset` and `length` options can be used to
+ * send only a part of the file. If `range` is given (normally the value of the
+ * request's `Range` header), a partial response (206) is sent for the requested
+ * range, or a 416 response if the range cannot be satisfied. Malformed ranges
+ * and multiple ranges are ignored, and the entire content is sent. On Linux,
+ * if `io` is an IO instance, the file is sent using sendfile(2), without
+ * passing through Ruby strings.
+ */
+VALUE H1P_send_file_response(int argc, VALUE *argv, VALUE self) {
+  VALUE io, headers, file, opts;
+  VALUE offset_arg = Qnil, length_arg = Qnil, range = Qnil;
+
+  rb_scan_args(argc, argv, "3:", &io, &headers, &file, &opts);
+  if (opts != Qnil) {
+    ID keys[3] = {ID_offset, ID_length, ID_range};
+    VALUE values[3];
+    rb_get_kwargs(opts, keys, 0, 3, values);
+    if (values[0] != Qundef) offset_arg = values[0];
+    if (values[1] != Qundef) length_arg = values[1];
+    if (values[2] != Qundef) range = values[2];
+  }
+
+  file = rb_io_get_io(file);
+#ifdef HAVE_RB_IO_DESCRIPTOR
+  int in_fd = rb_io_descriptor(file);
+#else
+  rb_io_t *fptr;
+  RB_IO_POINTER(file, fptr);
+  int in_fd = fptr->fd;
+#endif
+  struct stat st;
+  if (fstat(in_fd, &st)) rb_sys_fail("fstat");
+
+  off_t offset = (offset_arg == Qnil) ? 0 : NUM2OFFT(offset_arg);
+  if (offset < 0 || offset > st.st_size) rb_raise(eArgumentError, "Invalid offset");
+  off_t size = st.st_size - offset;
+  if (length_arg != Qnil) {
+    off_t length = NUM2OFFT(length_arg);
+    if (length < 0) rb_raise(eArgumentError, "Invalid length");
+    if (length < size) size = length;
+  }
+
+  send_response_ctx ctx;
+  send_response_ctx_init(&ctx, io);
+
+  VALUE protocol = rb_hash_aref(headers, STR_pseudo_protocol);
+  if (protocol == Qnil) protocol = STR_pseudo_protocol_default;
+  VALUE status = rb_hash_aref(headers, STR_pseudo_status);
+  if (status == Qnil) status = STR_pseudo_status_default;
 
-  return INT2FIX(ctx.total_written);
+  off_t start = 0, len = size;
+  VALUE content_range = Qnil;
+  if (range != Qnil) {
+    switch (parse_byte_range(StringValue(range), size, &start, &len)) {
+      case 1:
+        status = STR_status_partial_content;
+        content_range = rb_sprintf("bytes %lld-%lld/%lld", (long long)start, (long long)(start + len - 1), (long long)size);
+        break;
+      case 0:
+        status = STR_status_range_not_satisfiable;
+        content_range = rb_sprintf("bytes */%lld", (long long)size);
+        len = 0;
+        break;
+      default:
+        start = 0;
+        len = size;
+    }
+  }
+  send_response_write_status_line(&ctx, protocol, status);
+
+  rb_hash_foreach(headers, send_response_write_header, (VALUE)&ctx);
+  if (content_range != Qnil)
+    send_response_write_header(STR_content_range_capitalized, content_range, (VALUE)&ctx);
+  send_response_write_header(STR_content_length_capitalized, OFFT2NUM(len), (VALUE)&ctx);
+
+  ctx.buffer_ptr[ctx.buffer_len] = '\r';
+  ctx.buffer_ptr[ctx.buffer_len + 1] = '\n';
+  ctx.buffer_len += 2;
+
+#ifdef H1P_NATIVE_SENDFILE
+  if (ctx.native != -1 && len > 0) {
+    send_response_flush_buffer(&ctx);
+    io_native_sendfile(io, !ctx.native, in_fd, offset + start, len);
+    ctx.total_written += len;
+  }
+  else
+#endif
+    send_file_buffered(&ctx, in_fd, offset + start, len);
+  send_response_ctx_done(&ctx);
+
+  RB_GC_GUARD(ctx.buffer);
+  RB_GC_GUARD(content_range);
+  RB_GC_GUARD(file);
+  return LL2NUM((long long)ctx.total_written);
+}
+
+typedef struct response_template {
+  VALUE bytes; // frozen string holding the status line and fixed headers
+  int   date;  // whether to add a Date header
+} ResponseTemplate_t;
+
+static void ResponseTemplate_mark(void *ptr) {
+  ResponseTemplate_t *template = ptr;
+  rb_gc_mark(template->bytes);
+}
+
+static const rb_data_type_t ResponseTemplate_type = {
+  "ResponseTemplate",
+  {ResponseTemplate_mark, RUBY_TYPED_DEFAULT_FREE, 0,},
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+#define GetResponseTemplate(obj, template) \
+  TypedData_Get_Struct((obj), ResponseTemplate_t, &ResponseTemplate_type, (template))
+
+static VALUE ResponseTemplate_allocate(VALUE klass) {
+  ResponseTemplate_t *template;
+  VALUE obj = TypedData_Make_Struct(klass, ResponseTemplate_t, &ResponseTemplate_type, template);
+  template->bytes = Qnil;
+  template->date = 0;
+  return obj;
+}
+
+/* call-seq: H1P::ResponseTemplate.new(status, headers = {}, date: false) -> template
+ *
+ * Creates a response template with the given status and fixed headers, which
+ * are formatted once. The status may be an integer (formatted using a built-in
+ * table of reason phrases) or a string such as "404 Not Found". The protocol
+ * may be set using the :protocol pseudo header. If `date` is true, a Date
+ * header with the current (cached) date is added to each response.
+ */
+VALUE ResponseTemplate_initialize(int argc, VALUE *argv, VALUE self) {
+  ResponseTemplate_t *template;
+  GetResponseTemplate(self, template);
+  VALUE status;
+  VALUE headers;
+  VALUE opts;
+  rb_scan_args(argc, argv, "11:", &status, &headers, &opts);
+  template->date = date_kwarg(opts);
+
+  send_response_ctx ctx;
+  send_response_ctx_init(&ctx, Qnil);
+
+  VALUE protocol = (headers == Qnil) ? Qnil : rb_hash_aref(headers, STR_pseudo_protocol);
+  if (protocol == Qnil) protocol = STR_pseudo_protocol_default;
+  send_response_write_status_line(&ctx, protocol, status);
+  if (headers != Qnil)
+    rb_hash_foreach(headers, send_response_write_header, (VALUE)&ctx);
+
+  RB_OBJ_WRITE(self, &template->bytes, rb_obj_freeze(rb_str_new(ctx.buffer_ptr, ctx.buffer_len)));
+  RB_GC_GUARD(ctx.buffer);
+  return self;
+}
+
+/* call-seq: template.send(io, extra_headers = nil, body = nil) -> total_written
+ *
+ * Sends a response using the template's status line and headers, followed by
+ * the given extra headers, a Content-Length header and the body.
+ */
+VALUE ResponseTemplate_send(int argc, VALUE *argv, VALUE self) {
+  ResponseTemplate_t *template;
+  GetResponseTemplate(self, template);
+  VALUE io;
+  VALUE extra_headers;
+  VALUE body;
+  rb_scan_args(argc, argv, "12", &io, &extra_headers, &body);
+
+  send_response_ctx ctx;
+  send_response_ctx_init(&ctx, io);
+  // the template is written along with the dynamic headers, without copying it
+  ctx.prefix = template->bytes;
+
+  long bodylen = 0;
+  if (body != Qnil) {
+    if (TYPE(body) != T_STRING) body = rb_funcall(body, ID_to_s, 0);
+    bodylen = RSTRING_LEN(body);
+  }
+
+  if (extra_headers != Qnil)
+    rb_hash_foreach(extra_headers, send_response_write_header, (VALUE)&ctx);
+  if (template->date) send_response_write_date_header(&ctx);
+  send_response_write_header(STR_content_length_capitalized, LONG2FIX(bodylen), (VALUE)&ctx);
+
+  char *endptr = ctx.buffer_ptr + ctx.buffer_len;
+  endptr[0] = '\r';
+  endptr[1] = '\n';
+  ctx.buffer_len += 2;
+
+  send_response_flush_buffer_with(&ctx, bodylen ? body : Qnil);
+  send_response_ctx_done(&ctx);
+
+  RB_GC_GUARD(body);
+  RB_GC_GUARD(ctx.buffer);
+  return SIZET2NUM(ctx.total_written);
+}
+
+/* call-seq: template.to_s -> string
+ *
+ * Returns the formatted status line and headers.
+ */
+VALUE ResponseTemplate_to_s(VALUE self) {
+  ResponseTemplate_t *template;
+  GetResponseTemplate(self, template);
+  return template->bytes;
+}
+
+// Writes a chunk (with its length prefix and trailing CRLF) directly to the
+// fd of an IO instance, using a single writev(2) call.
+static inline size_t write_body_chunk_native(VALUE io, int nonblock, VALUE chunk) {
+#ifdef H1P_NATIVE_IO
+  char len_buf[24];
+  if (chunk == Qnil) {
+    struct iovec iov[1] = {{RSTRING_PTR(STR_EMPTY_CHUNK), RSTRING_LEN(STR_EMPTY_CHUNK)}};
+    return io_native_writev(io, !nonblock, iov, 1, NULL, 0);
+  }
+  int len_buf_len = sprintf(len_buf, "%lx\r\n", RSTRING_LEN(chunk));
+  struct iovec iov[3] = {
+    {len_buf, len_buf_len},
+    {RSTRING_PTR(chunk), RSTRING_LEN(chunk)},
+    {(char *)"\r\n", 2}
+  };
+  size_t written = io_native_writev(io, !nonblock, iov, 3, &chunk, 1);
+  RB_GC_GUARD(chunk);
+  return written;
+#else
+  return 0;
+#endif
 }
 
 /* call-seq: H1P.send_body_chunk(io, chunk) -> total_written
@@ -1305,9 +4161,15 @@ VALUE H1P_send_response(int argc,VALUE *argv, VALUE self) {
  * Sends a body chunk using chunked transfer encoding.
  */
 VALUE H1P_send_body_chunk(VALUE self, VALUE io, VALUE chunk) {
-  if (chunk != Qnil) {
-    if (TYPE(chunk) != T_STRING) chunk = rb_funcall(chunk, ID_to_s, 0);
+  if (chunk != Qnil && TYPE(chunk) != T_STRING) chunk = rb_funcall(chunk, ID_to_s, 0);
 
+  int nonblock = native_io_nonblock_p(io);
+  if (nonblock != -1) {
+    rb_io_flush(io);
+    return SIZET2NUM(write_body_chunk_native(io, nonblock, chunk));
+  }
+
+  if (chunk != Qnil) {
     VALUE len_string = rb_str_new_literal("");
     rb_str_modify_expand(len_string, 16);
     int len_string_len = sprintf(RSTRING_PTR(len_string), "%lx\r\n", RSTRING_LEN(chunk));
@@ -1324,15 +4186,18 @@ VALUE H1P_send_body_chunk(VALUE self, VALUE io, VALUE chunk) {
   }
 }
 
-/* call-seq: H1P.send_chunked_response(io, headers, body = nil) -> total_written
+/* call-seq: H1P.send_chunked_response(io, headers, date: false) { ... } -> total_written
  *
  * Sends an HTTP response with the given headers and body using chunked transfer
- * encoding.
+ * encoding. If `date` is true, a Date header with the current (cached) date is
+ * added.
  */
-VALUE H1P_send_chunked_response(VALUE self, VALUE io, VALUE headers) {
-  VALUE buffer = rb_str_new_literal("");
-  rb_str_modify_expand(buffer, MAX_RESPONSE_BUFFER_SIZE);
-  send_response_ctx ctx = {io, buffer, RSTRING_PTR(buffer), 0, 0};
+VALUE H1P_send_chunked_response(int argc, VALUE *argv, VALUE self) {
+  VALUE io, headers, opts;
+  rb_scan_args(argc, argv, "2:", &io, &headers, &opts);
+  int date = date_kwarg(opts);
+  send_response_ctx ctx;
+  send_response_ctx_init(&ctx, io);
 
   VALUE protocol = rb_hash_aref(headers, STR_pseudo_protocol);
   if (protocol == Qnil) protocol = STR_pseudo_protocol_default;
@@ -1341,25 +4206,31 @@ VALUE H1P_send_chunked_response(VALUE self, VALUE io, VALUE headers) {
   send_response_write_status_line(&ctx, protocol, status);
 
   rb_hash_foreach(headers, send_response_write_header, (VALUE)&ctx);
+  if (date) send_response_write_date_header(&ctx);
   send_response_write_header(STR_transfer_encoding_capitalized, STR_chunked, (VALUE)&ctx);
 
   ctx.buffer_ptr[ctx.buffer_len] = '\r';
   ctx.buffer_ptr[ctx.buffer_len + 1] = '\n';
   ctx.buffer_len += 2;
   send_response_flush_buffer(&ctx);
+  send_response_ctx_done(&ctx);
 
   VALUE len_string = rb_str_new_literal("");
   rb_str_modify_expand(len_string, 16);
   while (1) {
     VALUE chunk = rb_yield(Qnil);
-    if (chunk == Qnil) {
+    if (chunk != Qnil && TYPE(chunk) != T_STRING) chunk = rb_funcall(chunk, ID_to_s, 0);
+
+    if (ctx.native != -1) {
+      ctx.total_written += write_body_chunk_native(io, ctx.native, chunk);
+      if (chunk == Qnil) break;
+    }
+    else if (chunk == Qnil) {
       VALUE written = rb_funcall(io, ID_write, 1, STR_EMPTY_CHUNK);
       ctx.total_written += NUM2INT(written);
       break;
     }
     else {
-      if (TYPE(chunk) != T_STRING) chunk = rb_funcall(chunk, ID_to_s, 0);
-
       int len_string_len = sprintf(RSTRING_PTR(len_string), "%lx\r\n", RSTRING_LEN(chunk));
       rb_str_set_len(len_string,len_string_len);
       VALUE written = rb_funcall(io, ID_write, 3, len_string, chunk, STR_CRLF);
@@ -1369,9 +4240,278 @@ VALUE H1P_send_chunked_response(VALUE self, VALUE io, VALUE headers) {
   }
 
   RB_GC_GUARD(len_string);
-  RB_GC_GUARD(buffer);
+  RB_GC_GUARD(ctx.buffer);
+
+  return SIZET2NUM(ctx.total_written);
+}
+
+typedef struct chunked_writer {
+  send_response_ctx ctx;
+  size_t            flush_threshold;
+  int               finished;
+} ChunkedWriter_t;
+
+#define CHUNKED_WRITER_DEFAULT_FLUSH_THRESHOLD 16384
+
+static void ChunkedWriter_mark(void *ptr) {
+  ChunkedWriter_t *writer = ptr;
+  // the buffer is pinned, since the struct holds a pointer to its contents
+  rb_gc_mark(writer->ctx.io);
+  rb_gc_mark(writer->ctx.buffer);
+}
+
+static const rb_data_type_t ChunkedWriter_type = {
+  "ChunkedWriter",
+  {ChunkedWriter_mark, RUBY_TYPED_DEFAULT_FREE, 0,},
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+#define GetChunkedWriter(obj, writer) \
+  TypedData_Get_Struct((obj), ChunkedWriter_t, &ChunkedWriter_type, (writer))
+
+static VALUE ChunkedWriter_allocate(VALUE klass) {
+  ChunkedWriter_t *writer;
+  VALUE obj = TypedData_Make_Struct(klass, ChunkedWriter_t, &ChunkedWriter_type, writer);
+  writer->ctx.io = Qnil;
+  writer->ctx.buffer = Qnil;
+  writer->finished = 1;
+  return obj;
+}
+
+static inline void ChunkedWriter_flush_with(VALUE self, ChunkedWriter_t *writer, VALUE chunk) {
+  send_response_flush_buffer_with(&writer->ctx, chunk);
+  // a custom #write implementation might hold on to the buffer
+  if (writer->ctx.native == -1) {
+    VALUE buffer = rb_str_new_literal("");
+    rb_str_modify_expand(buffer, MAX_RESPONSE_BUFFER_SIZE);
+    RB_OBJ_WRITE(self, &writer->ctx.buffer, buffer);
+    writer->ctx.buffer_ptr = RSTRING_PTR(buffer);
+  }
+}
+
+/* call-seq: H1P::ChunkedWriter.new(io, headers, flush_threshold: 16384, date: false) -> writer
+ *
+ * Creates a writer for sending a response with the given headers using chunked
+ * transfer encoding. The response headers and body chunks are accumulated in a
+ * buffer, which is written once its size reaches the flush threshold, or when
+ * #flush or #finish are called. If `date` is true, a Date header with the
+ * current (cached) date is added.
+ */
+VALUE ChunkedWriter_initialize(int argc, VALUE *argv, VALUE self) {
+  ChunkedWriter_t *writer;
+  GetChunkedWriter(self, writer);
+  VALUE io, headers, opts;
+  int date = 0;
+  long flush_threshold = CHUNKED_WRITER_DEFAULT_FLUSH_THRESHOLD;
+
+  rb_scan_args(argc, argv, "2:", &io, &headers, &opts);
+  if (opts != Qnil) {
+    ID keys[2] = {ID_flush_threshold, ID_date};
+    VALUE values[2];
+    rb_get_kwargs(opts, keys, 0, 2, values);
+    if (values[0] != Qundef) flush_threshold = NUM2LONG(values[0]);
+    if (values[1] != Qundef) date = RTEST(values[1]);
+  }
+  if (flush_threshold < 0) flush_threshold = 0;
+  if (flush_threshold > MAX_RESPONSE_BUFFER_SIZE / 2) flush_threshold = MAX_RESPONSE_BUFFER_SIZE / 2;
+
+  // For IO instances, the buffer is taken from the response buffer pool, and
+  // is returned to the pool by #finish (a writer that is never finished just
+  // drops it). For other targets, a new buffer is allocated, since it is passed
+  // to io.write, which might hold on to it.
+  int native = native_io_nonblock_p(io);
+  VALUE buffer;
+  if (native != -1) {
+    rb_io_flush(io);
+    buffer = response_buffer_acquire();
+  }
+  else {
+    buffer = rb_str_new_literal("");
+    rb_str_modify_expand(buffer, MAX_RESPONSE_BUFFER_SIZE);
+  }
+  writer->ctx = (send_response_ctx){
+    .io = Qnil, .native = native, .prefix = Qnil, .buffer = Qnil,
+    .buffer_ptr = RSTRING_PTR(buffer), .buffer_len = 0, .total_written = 0
+  };
+  RB_OBJ_WRITE(self, &writer->ctx.io, io);
+  RB_OBJ_WRITE(self, &writer->ctx.buffer, buffer);
+  writer->flush_threshold = flush_threshold;
+  writer->finished = 0;
+
+  send_response_ctx *ctx = &writer->ctx;
+  VALUE protocol = rb_hash_aref(headers, STR_pseudo_protocol);
+  if (protocol == Qnil) protocol = STR_pseudo_protocol_default;
+  VALUE status = rb_hash_aref(headers, STR_pseudo_status);
+  if (status == Qnil) status = STR_pseudo_status_default;
+  send_response_write_status_line(ctx, protocol, status);
+
+  rb_hash_foreach(headers, send_response_write_header, (VALUE)ctx);
+  if (date) send_response_write_date_header(ctx);
+  send_response_write_header(STR_transfer_encoding_capitalized, STR_chunked, (VALUE)ctx);
 
-  return INT2FIX(ctx.total_written);
+  ctx->buffer_ptr[ctx->buffer_len] = '\r';
+  ctx->buffer_ptr[ctx->buffer_len + 1] = '\n';
+  ctx->buffer_len += 2;
+  if (ctx->buffer_len >= writer->flush_threshold) ChunkedWriter_flush_with(self, writer, Qnil);
+
+  return self;
+}
+
+static inline ChunkedWriter_t *ChunkedWriter_get_open(VALUE self) {
+  ChunkedWriter_t *writer;
+  GetChunkedWriter(self, writer);
+  if (writer->finished) rb_raise(rb_eIOError, "chunked writer is finished");
+  return writer;
+}
+
+/* call-seq: writer.write(chunk) -> writer
+ *           writer << chunk -> writer
+ *
+ * Writes a body chunk. Small chunks are accumulated in the writer's buffer.
+ * When the buffer would exceed the flush threshold, its contents are written
+ * together with the chunk in a single (gather) write. Empty chunks are ignored.
+ */
+VALUE ChunkedWriter_write(VALUE self, VALUE chunk) {
+  ChunkedWriter_t *writer = ChunkedWriter_get_open(self);
+  send_response_ctx *ctx = &writer->ctx;
+  if (TYPE(chunk) != T_STRING) chunk = rb_funcall(chunk, ID_to_s, 0);
+  long len = RSTRING_LEN(chunk);
+  if (!len) return self;
+
+  ctx->buffer_len += sprintf(ctx->buffer_ptr + ctx->buffer_len, "%lx\r\n", len);
+  if (ctx->buffer_len + (size_t)len + 2 > writer->flush_threshold) {
+    ChunkedWriter_flush_with(self, writer, chunk);
+  }
+  else {
+    memcpy(ctx->buffer_ptr + ctx->buffer_len, RSTRING_PTR(chunk), len);
+    ctx->buffer_len += len;
+  }
+  // the trailing CRLF is coalesced with whatever comes next
+  ctx->buffer_ptr[ctx->buffer_len] = '\r';
+  ctx->buffer_ptr[ctx->buffer_len + 1] = '\n';
+  ctx->buffer_len += 2;
+
+  RB_GC_GUARD(chunk);
+  return self;
+}
+
+/* call-seq: writer.flush -> writer
+ *
+ * Writes any buffered data.
+ */
+VALUE ChunkedWriter_flush(VALUE self) {
+  ChunkedWriter_t *writer = ChunkedWriter_get_open(self);
+  if (writer->ctx.buffer_len) ChunkedWriter_flush_with(self, writer, Qnil);
+  return self;
+}
+
+/* call-seq: writer.finish -> total_written
+ *
+ * Writes the terminating empty chunk along with any buffered data, and returns
+ * the total number of bytes written.
+ */
+VALUE ChunkedWriter_finish(VALUE self) {
+  ChunkedWriter_t *writer = ChunkedWriter_get_open(self);
+  send_response_ctx *ctx = &writer->ctx;
+
+  memcpy(ctx->buffer_ptr + ctx->buffer_len, "0\r\n\r\n", 5);
+  ctx->buffer_len += 5;
+  writer->finished = 1;
+  send_response_flush_buffer(ctx);
+  if (ctx->native != -1) {
+    response_buffer_release(ctx->buffer);
+    RB_OBJ_WRITE(self, &ctx->buffer, Qnil);
+    ctx->buffer_ptr = NULL;
+  }
+  return SIZET2NUM(ctx->total_written);
+}
+
+static VALUE BufferPool_allocate(VALUE klass) {
+  BufferPool_t *pool;
+  VALUE obj = TypedData_Make_Struct(klass, BufferPool_t, &BufferPool_type, pool);
+  pool->class_count = 0;
+  pool->refs = 1;
+  return obj;
+}
+
+#define BUFFER_POOL_DEFAULT_MAX_FREE 1024
+
+/* call-seq: H1P::BufferPool.new(sizes: [4096, 16384, 65536], max_free: 1024) -> pool
+ *
+ * Creates a buffer pool with the given buffer size classes. Parsers created
+ * with the `buffer_pool` option borrow their buffer from the pool when a read
+ * starts, and return it once it is fully consumed, so that parsers for idle
+ * connections hold no buffer. When the pool has no free buffer of the needed
+ * size, a new buffer is allocated. Up to `max_free` free buffers are kept per
+ * size class.
+ */
+VALUE BufferPool_initialize(int argc, VALUE *argv, VALUE self) {
+  BufferPool_t *pool;
+  GetBufferPool(self, pool);
+  VALUE opts;
+  rb_scan_args(argc, argv, "0:", &opts);
+
+  VALUE sizes = Qundef;
+  pool->max_free = BUFFER_POOL_DEFAULT_MAX_FREE;
+  if (opts != Qnil) {
+    ID keys[2] = {ID_sizes, ID_max_free};
+    VALUE values[2];
+    rb_get_kwargs(opts, keys, 0, 2, values);
+    sizes = values[0];
+    if (values[1] != Qundef) pool->max_free = NUM2INT(values[1]);
+  }
+  if (pool->max_free < 0) rb_raise(eArgumentError, "max_free must not be negative");
+
+  if (sizes == Qundef) {
+    pool->class_count = 3;
+    pool->sizes[0] = 4096;
+    pool->sizes[1] = 16384;
+    pool->sizes[2] = 65536;
+  }
+  else {
+    Check_Type(sizes, T_ARRAY);
+    int count = RARRAY_LEN(sizes);
+    if (count < 1 || count > BUFFER_POOL_MAX_CLASSES)
+      rb_raise(eArgumentError, "sizes must have 1 to %d entries", BUFFER_POOL_MAX_CLASSES);
+    for (int i = 0; i < count; i++) {
+      pool->sizes[i] = NUM2INT(RARRAY_AREF(sizes, i));
+      if (pool->sizes[i] < MIN_BUFFER_SIZE || pool->sizes[i] > MAX_BODY_READ_LENGTH)
+        rb_raise(eArgumentError, "Buffer sizes must be between %d and %d", MIN_BUFFER_SIZE, MAX_BODY_READ_LENGTH);
+      if (i && pool->sizes[i] <= pool->sizes[i - 1])
+        rb_raise(eArgumentError, "Buffer sizes must be in ascending order");
+    }
+    pool->class_count = count;
+  }
+
+  for (int i = 0; i < pool->class_count; i++) {
+    RB_OBJ_WRITE(self, &pool->free[i], rb_ary_new());
+    pool->in_use[i] = 0;
+    pool->allocated[i] = 0;
+  }
+  return self;
+}
+
+/* call-seq: pool.stats -> array
+ *
+ * Returns the occupancy of the pool, as an array with a hash for each size
+ * class, containing the buffer `:size`, the number of `:free` buffers, the
+ * number of buffers `:in_use` by parsers, and the number of buffers
+ * `:allocated` by the pool (when no free buffer was available).
+ */
+VALUE BufferPool_stats(VALUE self) {
+  BufferPool_t *pool;
+  GetBufferPool(self, pool);
+
+  VALUE stats = rb_ary_new_capa(pool->class_count);
+  for (int i = 0; i < pool->class_count; i++) {
+    VALUE entry = rb_hash_new();
+    rb_hash_aset(entry, ID2SYM(ID_size), INT2NUM(pool->sizes[i]));
+    rb_hash_aset(entry, ID2SYM(ID_free), LONG2NUM(RARRAY_LEN(pool->free[i])));
+    rb_hash_aset(entry, ID2SYM(ID_in_use), LONG2NUM(pool->in_use[i]));
+    rb_hash_aset(entry, ID2SYM(ID_allocated), LONG2NUM(pool->allocated[i]));
+    rb_ary_push(stats, entry);
+  }
+  return stats;
 }
 
 void Init_H1P(void) {
@@ -1386,16 +4526,76 @@ void Init_H1P(void) {
   cError = rb_define_class_under(mH1P, "Error", rb_eRuntimeError);
   rb_gc_register_mark_object(cError);
 
-  rb_define_method(cParser, "initialize", Parser_initialize, 2);
-  rb_define_method(cParser, "parse_headers", Parser_parse_headers, 0);
+  rb_define_method(cParser, "initialize", Parser_initialize, -1);
+  rb_define_method(cParser, "parse_headers", Parser_parse_headers, -1);
   rb_define_method(cParser, "read_body", Parser_read_body, 0);
   rb_define_method(cParser, "read_body_chunk", Parser_read_body_chunk, 1);
+  rb_define_method(cParser, "read_body_into", Parser_read_body_into, 1);
+  rb_define_method(cParser, "read_body_chunk_into", Parser_read_body_chunk_into, 2);
   rb_define_method(cParser, "splice_body_to", Parser_splice_body_to, 1);
   rb_define_method(cParser, "complete?", Parser_complete_p, 0);
+  rb_define_method(cParser, "content_length", Parser_content_length, 0);
+  rb_define_method(cParser, "trailers", Parser_trailers, 0);
+  rb_define_method(cParser, "chunked?", Parser_chunked_p, 0);
+  rb_define_method(cParser, "keep_alive?", Parser_keep_alive_p, 0);
+  rb_define_method(cParser, "upgrade?", Parser_upgrade_p, 0);
+  rb_define_method(cParser, "expect_continue?", Parser_expect_continue_p, 0);
+  rb_define_method(cParser, "parse_buffered_requests", Parser_parse_buffered_requests, 0);
+  rb_define_method(cParser, "<<", Parser_push, 1);
+  rb_define_method(cParser, "stats", Parser_stats, 0);
+  rb_define_method(cParser, "timings", Parser_timings, 0);
+
+  cHeaders = rb_define_class_under(mH1P, "Headers", rb_cObject);
+  rb_undef_alloc_func(cHeaders);
+  rb_define_method(cHeaders, "[]", Headers_aref, 1);
+  rb_define_method(cHeaders, "[]=", Headers_aset, 2);
+  rb_define_method(cHeaders, "key?", Headers_key_p, 1);
+  rb_define_method(cHeaders, "to_h", Headers_to_h, 0);
+
+  cResponseTemplate = rb_define_class_under(mH1P, "ResponseTemplate", rb_cObject);
+  rb_define_alloc_func(cResponseTemplate, ResponseTemplate_allocate);
+  rb_define_method(cResponseTemplate, "initialize", ResponseTemplate_initialize, -1);
+  rb_define_method(cResponseTemplate, "send", ResponseTemplate_send, -1);
+  rb_define_method(cResponseTemplate, "to_s", ResponseTemplate_to_s, 0);
+
+  cChunkedWriter = rb_define_class_under(mH1P, "ChunkedWriter", rb_cObject);
+  rb_define_alloc_func(cChunkedWriter, ChunkedWriter_allocate);
+  rb_define_method(cChunkedWriter, "initialize", ChunkedWriter_initialize, -1);
+  rb_define_method(cChunkedWriter, "write", ChunkedWriter_write, 1);
+  rb_define_method(cChunkedWriter, "<<", ChunkedWriter_write, 1);
+  rb_define_method(cChunkedWriter, "flush", ChunkedWriter_flush, 0);
+  rb_define_method(cChunkedWriter, "finish", ChunkedWriter_finish, 0);
+
+  cBufferPool = rb_define_class_under(mH1P, "BufferPool", rb_cObject);
+  rb_define_alloc_func(cBufferPool, BufferPool_allocate);
+  rb_define_method(cBufferPool, "initialize", BufferPool_initialize, -1);
+  rb_define_method(cBufferPool, "stats", BufferPool_stats, 0);
 
   rb_define_singleton_method(mH1P, "send_response", H1P_send_response, -1);
   rb_define_singleton_method(mH1P, "send_body_chunk", H1P_send_body_chunk, 2);
-  rb_define_singleton_method(mH1P, "send_chunked_response", H1P_send_chunked_response, 2);
+  rb_define_singleton_method(mH1P, "send_chunked_response", H1P_send_chunked_response, -1);
+  rb_define_singleton_method(mH1P, "send_file_response", H1P_send_file_response, -1);
+  rb_define_singleton_method(mH1P, "stats", H1P_stats, 0);
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  // H1P.http_date uses no Ruby-level state, and can be called from any Ractor
+  rb_ext_ractor_safe(true);
+#endif
+  rb_define_singleton_method(mH1P, "http_date", H1P_http_date, 0);
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(false);
+#endif
+
+  const char *stats_names[] = {
+    "reads", "bytes_read", "buffer_refills", "buffer_trims", "buffer_bytes_moved",
+    "buffer_high_water", "requests", "body_bytes_read", "body_bytes_spliced"
+  };
+  for (int i = 0; i < STATS_COUNTER_COUNT; i++) stats_ids[i] = rb_intern(stats_names[i]);
+  stats_errors_id = rb_intern("errors");
+  stats_error_ids[ERR_START_LINE]       = rb_intern("start_line");
+  stats_error_ids[ERR_HEADER]           = rb_intern("header");
+  stats_error_ids[ERR_BODY]             = rb_intern("body");
+  stats_error_ids[ERR_INCOMPLETE_BODY]  = rb_intern("incomplete_body");
 
   ID_arity                  = rb_intern("arity");
   ID_backend_read           = rb_intern("backend_read");
@@ -1404,10 +4604,29 @@ void Init_H1P(void) {
   ID_backend_splice         = rb_intern("backend_splice");
   ID_backend_write          = rb_intern("backend_write");
   ID_call                   = rb_intern("call");
+  ID_date                   = rb_intern("date");
   ID_downcase               = rb_intern("downcase");
   ID_eof_p                  = rb_intern("eof?");
-  ID_eq                     = rb_intern("==");
+  ID_flush_threshold        = rb_intern("flush_threshold");
   ID_join                   = rb_intern("join");
+  ID_body_done              = rb_intern("body_done");
+  ID_first_byte             = rb_intern("first_byte");
+  ID_headers_done           = rb_intern("headers_done");
+  ID_allocated              = rb_intern("allocated");
+  ID_buffer_pool            = rb_intern("buffer_pool");
+  ID_free                   = rb_intern("free");
+  ID_in_use                 = rb_intern("in_use");
+  ID_max_free               = rb_intern("max_free");
+  ID_size                   = rb_intern("size");
+  ID_sizes                  = rb_intern("sizes");
+  ID_lazy                   = rb_intern("lazy");
+  ID_max_read_size          = rb_intern("max_read_size");
+  ID_ring_buffer            = rb_intern("ring_buffer");
+  ID_min_buffer_size        = rb_intern("min_buffer_size");
+  ID_timings                = rb_intern("timings");
+  ID_length                 = rb_intern("length");
+  ID_offset                 = rb_intern("offset");
+  ID_range                  = rb_intern("range");
   ID_read_method            = rb_intern("__read_method__");
   ID_read                   = rb_intern("read");
   ID_readpartial            = rb_intern("readpartial");
@@ -1417,7 +4636,6 @@ void Init_H1P(void) {
   ID_write                  = rb_intern("write");
   ID_write_method           = rb_intern("__write_method__");
 
-  NUM_max_headers_read_length = INT2FIX(MAX_HEADERS_READ_LENGTH);
   NUM_buffer_start = INT2FIX(0);
   NUM_buffer_end = INT2FIX(-1);
 
@@ -1430,15 +4648,27 @@ void Init_H1P(void) {
   GLOBAL_STR(STR_pseudo_status_default,       "200 OK");
   GLOBAL_STR(STR_pseudo_status_message,       ":status_message");
 
+  GLOBAL_STR(STR_method_get,                  "GET");
+  GLOBAL_STR(STR_method_post,                 "POST");
+  GLOBAL_STR(STR_method_put,                  "PUT");
+  GLOBAL_STR(STR_method_head,                 "HEAD");
+  GLOBAL_STR(STR_method_patch,                "PATCH");
+  GLOBAL_STR(STR_method_delete,               "DELETE");
+  GLOBAL_STR(STR_method_options,              "OPTIONS");
+  GLOBAL_STR(STR_protocol_http_1_0,           "http/1.0");
+  GLOBAL_STR(STR_protocol_http_1_1,           "http/1.1");
+
   GLOBAL_STR(STR_chunked,                       "chunked");
-  GLOBAL_STR(STR_content_length,                "content-length");
   GLOBAL_STR(STR_content_length_capitalized,    "Content-Length");
-  GLOBAL_STR(STR_transfer_encoding,             "transfer-encoding");
   GLOBAL_STR(STR_transfer_encoding_capitalized, "Transfer-Encoding");
+  GLOBAL_STR(STR_content_range_capitalized,     "Content-Range");
+  GLOBAL_STR(STR_status_partial_content,        "206 Partial Content");
+  GLOBAL_STR(STR_status_range_not_satisfiable,  "416 Range Not Satisfiable");
 
   GLOBAL_STR(STR_CRLF,                          "\r\n");
   GLOBAL_STR(STR_EMPTY_CHUNK,                   "0\r\n\r\n");
   GLOBAL_STR(STR_COMMA_SPACE,                   ", ");
+  GLOBAL_STR(STR_released_buffer,               "");
 
   SYM_backend_read  = ID2SYM(ID_backend_read);
   SYM_backend_recv  = ID2SYM(ID_backend_recv);
@@ -1448,13 +4678,33 @@ void Init_H1P(void) {
   SYM_stock_readpartial = ID2SYM(rb_intern("stock_readpartial"));
   
   SYM_client = ID2SYM(rb_intern("client"));
+  SYM_need_more = ID2SYM(rb_intern("need_more"));
   SYM_server = ID2SYM(rb_intern("server"));
 
   rb_global_variable(&mH1P);
 
+  response_buffer_pool = rb_ary_new();
+  rb_global_variable(&response_buffer_pool);
+
+  enc_utf8 = rb_utf8_encoding();
+
+  const char *token_chars = "!#$%&'*+-.^_`|~";
+  for (int c = 0; c < 256; c++) {
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c && strchr(token_chars, c)))
+      token_lower[c] = c;
+    else if (c >= 'A' && c <= 'Z')
+      token_lower[c] = c + ('a' - 'A');
+  }
+
+  for (int i = 0; i < HEADER_NAME_COUNT; i++) {
+    header_name_strs[i] = rb_enc_interned_str(header_names[i].name, header_names[i].len, enc_utf8);
+    rb_gc_register_mark_object(header_name_strs[i]);
+  }
+
   eArgumentError = rb_const_get(rb_cObject, rb_intern("ArgumentError"));
 }
 
 void Init_h1p_ext(void) {
+  Init_Scan();
   Init_H1P();
 }
@@ -3,6 +3,19 @@
 
 #include "ruby.h"
 
+// scan.c
+typedef size_t (*scan_func)(const char *ptr, size_t len);
+extern scan_func scan_target;
+extern scan_func scan_field_value;
+void Init_Scan(void);
+
+// ring.c
+#if defined(__linux__) && defined(HAVE_MEMFD_CREATE)
+#define H1P_RING_BUFFER
+char *ring_map(size_t *size);
+void ring_unmap(char *ptr, size_t size);
+#endif
+
 // debugging
 #define OBJ_ID(obj) (NUM2LONG(rb_funcall(obj, rb_intern("object_id"), 0)))
 #define INSPECT(str, obj) { printf(str); VALUE s = rb_funcall(obj, rb_intern("inspect"), 0); printf(": %s\n", StringValueCStr(s)); }
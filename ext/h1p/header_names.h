@@ -0,0 +1,132 @@
+// Generated by header_names.rb, do not edit.
+
+#define HEADER_NAME_COUNT 81
+#define HEADER_NAME_SLOTS 512
+
+// Hashes a header name given as lowercase characters at positions 0, len / 2,
+// len - 2 and len - 1 (names are at least 2 characters long).
+#define HEADER_NAME_HASH(c0, mid, c2, c1, len) \
+  (((c0) * 116 + (mid) * 58 + (c2) * 67 + (c1) * 89 + (len)) & (HEADER_NAME_SLOTS - 1))
+
+static const struct header_name {
+  const char *name;
+  int len;
+} header_names[HEADER_NAME_COUNT] = {
+  {"accept", 6},
+  {"accept-charset", 14},
+  {"accept-encoding", 15},
+  {"accept-language", 15},
+  {"accept-ranges", 13},
+  {"access-control-allow-credentials", 32},
+  {"access-control-allow-headers", 28},
+  {"access-control-allow-methods", 28},
+  {"access-control-allow-origin", 27},
+  {"access-control-request-headers", 30},
+  {"access-control-request-method", 29},
+  {"age", 3},
+  {"authorization", 13},
+  {"cache-control", 13},
+  {"connection", 10},
+  {"content-disposition", 19},
+  {"content-encoding", 16},
+  {"content-language", 16},
+  {"content-length", 14},
+  {"content-location", 16},
+  {"content-range", 13},
+  {"content-security-policy", 23},
+  {"content-type", 12},
+  {"cookie", 6},
+  {"date", 4},
+  {"dnt", 3},
+  {"etag", 4},
+  {"expect", 6},
+  {"expires", 7},
+  {"forwarded", 9},
+  {"from", 4},
+  {"host", 4},
+  {"if-match", 8},
+  {"if-modified-since", 17},
+  {"if-none-match", 13},
+  {"if-range", 8},
+  {"if-unmodified-since", 19},
+  {"keep-alive", 10},
+  {"last-modified", 13},
+  {"link", 4},
+  {"location", 8},
+  {"origin", 6},
+  {"pragma", 6},
+  {"priority", 8},
+  {"proxy-authorization", 19},
+  {"range", 5},
+  {"referer", 7},
+  {"retry-after", 11},
+  {"sec-ch-ua", 9},
+  {"sec-ch-ua-mobile", 16},
+  {"sec-ch-ua-platform", 18},
+  {"sec-fetch-dest", 14},
+  {"sec-fetch-mode", 14},
+  {"sec-fetch-site", 14},
+  {"sec-fetch-user", 14},
+  {"sec-websocket-accept", 20},
+  {"sec-websocket-extensions", 24},
+  {"sec-websocket-key", 17},
+  {"sec-websocket-protocol", 22},
+  {"sec-websocket-version", 21},
+  {"server", 6},
+  {"set-cookie", 10},
+  {"strict-transport-security", 25},
+  {"te", 2},
+  {"trailer", 7},
+  {"transfer-encoding", 17},
+  {"upgrade", 7},
+  {"upgrade-insecure-requests", 25},
+  {"user-agent", 10},
+  {"vary", 4},
+  {"via", 3},
+  {"www-authenticate", 16},
+  {"x-content-type-options", 22},
+  {"x-csrf-token", 12},
+  {"x-forwarded-for", 15},
+  {"x-forwarded-host", 16},
+  {"x-forwarded-proto", 17},
+  {"x-frame-options", 15},
+  {"x-real-ip", 9},
+  {"x-request-id", 12},
+  {"x-requested-with", 16}
+};
+
+// Maps hash values to header_names indexes + 1 (0 for an empty slot)
+static const unsigned char header_name_slots[HEADER_NAME_SLOTS] = {
+  0, 0, 63, 0, 16, 0, 0, 0, 0, 0, 0, 0, 77, 0, 0, 0,
+  0, 54, 56, 7, 11, 0, 0, 0, 0, 0, 0, 51, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 69, 0, 67, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  9, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 31, 0, 0, 72, 0, 0, 0, 0, 43, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 17, 0, 8, 0, 0, 0, 0, 0, 0,
+  0, 0, 65, 0, 0, 34, 0, 0, 0, 71, 0, 0, 0, 0, 0, 38,
+  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 41, 0, 4, 0, 0,
+  0, 0, 0, 0, 35, 0, 0, 0, 0, 0, 0, 0, 0, 5, 0, 15,
+  0, 0, 47, 0, 0, 73, 0, 0, 0, 55, 0, 46, 0, 0, 0, 20,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 0, 0, 79, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 28, 0, 49, 0, 64, 0, 61,
+  0, 0, 75, 0, 27, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 52, 0, 0, 0, 44, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 25, 13, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 2, 0, 0, 0, 70, 0, 0, 0, 0, 81, 0, 0, 0,
+  0, 57, 0, 21, 0, 0, 0, 0, 0, 0, 0, 74, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 39, 0, 0, 0, 0, 0, 0, 26, 0, 12,
+  0, 42, 0, 0, 0, 0, 78, 0, 0, 0, 0, 0, 66, 0, 30, 22,
+  0, 0, 0, 0, 0, 0, 18, 0, 0, 0, 0, 0, 0, 0, 3, 0,
+  0, 0, 0, 0, 0, 76, 0, 50, 0, 0, 0, 0, 0, 80, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 23, 0, 32,
+  19, 0, 0, 0, 0, 0, 0, 33, 36, 0, 0, 0, 0, 59, 45, 0,
+  0, 0, 0, 0, 0, 0, 0, 10, 24, 0, 60, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 37, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 58, 0, 0, 0, 0, 0, 0, 0, 0, 0, 40, 0, 0,
+  0, 53, 68, 0, 62, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  14, 0, 0, 0, 0, 0, 48, 0, 0, 0, 0, 0, 0, 0, 0, 29
+};
@@ -0,0 +1,139 @@
+# frozen_string_literal: true
+
+# Generates header_names.h, a perfect hash table of well-known header names
+# used by the parser to return preallocated keys. Run this script after
+# changing the list below:
+#
+#   ruby ext/h1p/header_names.rb > ext/h1p/header_names.h
+
+H1P_HEADER_NAMES = %w[
+  accept
+  accept-charset
+  accept-encoding
+  accept-language
+  accept-ranges
+  access-control-allow-credentials
+  access-control-allow-headers
+  access-control-allow-methods
+  access-control-allow-origin
+  access-control-request-headers
+  access-control-request-method
+  age
+  authorization
+  cache-control
+  connection
+  content-disposition
+  content-encoding
+  content-language
+  content-length
+  content-location
+  content-range
+  content-security-policy
+  content-type
+  cookie
+  date
+  dnt
+  etag
+  expect
+  expires
+  forwarded
+  from
+  host
+  if-match
+  if-modified-since
+  if-none-match
+  if-range
+  if-unmodified-since
+  keep-alive
+  last-modified
+  link
+  location
+  origin
+  pragma
+  priority
+  proxy-authorization
+  range
+  referer
+  retry-after
+  sec-ch-ua
+  sec-ch-ua-mobile
+  sec-ch-ua-platform
+  sec-fetch-dest
+  sec-fetch-mode
+  sec-fetch-site
+  sec-fetch-user
+  sec-websocket-accept
+  sec-websocket-extensions
+  sec-websocket-key
+  sec-websocket-protocol
+  sec-websocket-version
+  server
+  set-cookie
+  strict-transport-security
+  te
+  trailer
+  transfer-encoding
+  upgrade
+  upgrade-insecure-requests
+  user-agent
+  vary
+  via
+  www-authenticate
+  x-content-type-options
+  x-csrf-token
+  x-forwarded-for
+  x-forwarded-host
+  x-forwarded-proto
+  x-frame-options
+  x-real-ip
+  x-request-id
+  x-requested-with
+].freeze
+
+H1P_HEADER_NAME_SLOTS = 512
+
+def header_name_hash(name, coeffs)
+  a, b, c, d = coeffs
+  (name.getbyte(0) * a + name.getbyte(name.bytesize / 2) * b +
+   name.getbyte(-2) * c + name.getbyte(-1) * d + name.bytesize) & (H1P_HEADER_NAME_SLOTS - 1)
+end
+
+def find_header_name_coeffs
+  rand = Random.new(1)
+  1_000_000.times do
+    coeffs = Array.new(4) { rand.rand(1..127) }
+    hashes = H1P_HEADER_NAMES.map { header_name_hash(_1, coeffs) }
+    return coeffs if hashes.uniq.size == hashes.size
+  end
+  raise 'No perfect hash found'
+end
+
+if __FILE__ == $0
+  coeffs = find_header_name_coeffs
+  slots = Array.new(H1P_HEADER_NAME_SLOTS, 0)
+  H1P_HEADER_NAMES.each_with_index { |n, i| slots[header_name_hash(n, coeffs)] = i + 1 }
+
+  puts <<~EOF
+    // Generated by header_names.rb, do not edit.
+
+    #define HEADER_NAME_COUNT #{H1P_HEADER_NAMES.size}
+    #define HEADER_NAME_SLOTS #{H1P_HEADER_NAME_SLOTS}
+
+    // Hashes a header name given as lowercase characters at positions 0, len / 2,
+    // len - 2 and len - 1 (names are at least 2 characters long).
+    #define HEADER_NAME_HASH(c0, mid, c2, c1, len) \\
+      (((c0) * #{coeffs[0]} + (mid) * #{coeffs[1]} + (c2) * #{coeffs[2]} + (c1) * #{coeffs[3]} + (len)) & (HEADER_NAME_SLOTS - 1))
+
+    static const struct header_name {
+      const char *name;
+      int len;
+    } header_names[HEADER_NAME_COUNT] = {
+    #{H1P_HEADER_NAMES.map { |n| %(  {"#{n}", #{n.bytesize}}) }.join(",\n")}
+    };
+
+    // Maps hash values to header_names indexes + 1 (0 for an empty slot)
+    static const unsigned char header_name_slots[HEADER_NAME_SLOTS] = {
+    #{slots.each_slice(16).map { |s| '  ' + s.join(', ') }.join(",\n")}
+    };
+  EOF
+end
@@ -8,4 +8,5 @@ H1P_LIMITS = {
   max_header_value_length:                2048,
   max_header_count:                       256,
   max_chunked_encoding_chunk_size_length: 16,
+  max_chunk_extensions_length:            256,
 }
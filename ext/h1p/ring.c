@@ -0,0 +1,51 @@
+#include "h1p.h"
+
+#ifdef H1P_RING_BUFFER
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Mirrored ring buffer mappings. A memfd of the given size is mapped twice into
+// adjacent virtual memory regions, so that any span of up to size bytes
+// starting in the first region is contiguous in memory, regardless of where it
+// wraps around.
+
+static size_t page_size(void) {
+  static size_t size = 0;
+  if (!size) size = (size_t)sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+// Maps a ring buffer of at least *size bytes (rounded up to the page size),
+// setting *size to the actual size. Returns NULL on failure, with errno set.
+char *ring_map(size_t *size) {
+  size_t page = page_size();
+  size_t len = (*size + page - 1) / page * page;
+
+  int fd = memfd_create("h1p_ring", MFD_CLOEXEC);
+  if (fd < 0) return NULL;
+  if (ftruncate(fd, len) < 0) goto fail_fd;
+
+  // reserve a contiguous region for both mappings
+  char *base = mmap(NULL, len * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) goto fail_fd;
+
+  if (mmap(base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+      mmap(base + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    goto fail_map;
+
+  close(fd);
+  *size = len;
+  return base;
+fail_map:
+  munmap(base, len * 2);
+fail_fd:
+  close(fd);
+  return NULL;
+}
+
+void ring_unmap(char *ptr, size_t size) {
+  munmap(ptr, size * 2);
+}
+
+#endif /* H1P_RING_BUFFER */
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <string.h>
+#include "h1p.h"
+
+// Delimiter scanning for the parser's hot loops. Each scanner returns the
+// number of leading bytes in the given range that can be consumed without
+// further inspection, i.e. the offset of the first delimiter or invalid control
+// byte (or len if none was found). Two byte classes are supported:
+//
+// - target: stops at any byte <= 0x20 (space, CR, LF, control bytes) or DEL.
+// - field value: stops at any control byte except HTAB, or DEL.
+//
+// The implementation is picked at runtime according to the CPU: AVX2 (32 bytes
+// per iteration), SSE4.2 (16 bytes per iteration) or a portable SWAR fallback
+// (8 bytes per iteration).
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define H1P_SCAN_X86
+#include <immintrin.h>
+#endif
+
+scan_func scan_target;
+scan_func scan_field_value;
+
+static inline int is_target_delim(unsigned char c) {
+  return c <= 0x20 || c == 0x7f;
+}
+
+static inline int is_field_value_delim(unsigned char c) {
+  return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+#define SWAR_ONES   0x0101010101010101ULL
+#define SWAR_HIGHS  0x8080808080808080ULL
+
+// Non-zero if any byte in x is less than n (n <= 128)
+#define SWAR_HAS_LESS(x, n) (((x) - SWAR_ONES * (n)) & ~(x) & SWAR_HIGHS)
+// Non-zero if any byte in x equals n
+#define SWAR_HAS_BYTE(x, n) SWAR_HAS_LESS((x) ^ (SWAR_ONES * (n)), 1)
+
+static size_t scan_target_swar(const char *ptr, size_t len) {
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t x;
+    memcpy(&x, ptr + i, 8);
+    if (SWAR_HAS_LESS(x, 0x21) | SWAR_HAS_BYTE(x, 0x7f)) break;
+  }
+  for (; i < len; i++)
+    if (is_target_delim(ptr[i])) break;
+  return i;
+}
+
+static size_t scan_field_value_swar(const char *ptr, size_t len) {
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t x;
+    memcpy(&x, ptr + i, 8);
+    // HTAB sets off the test, so the flagged word is checked byte by byte
+    if (SWAR_HAS_LESS(x, 0x20) | SWAR_HAS_BYTE(x, 0x7f)) {
+      for (size_t j = i; j < i + 8; j++)
+        if (is_field_value_delim(ptr[j])) return j;
+    }
+  }
+  for (; i < len; i++)
+    if (is_field_value_delim(ptr[i])) break;
+  return i;
+}
+
+#ifdef H1P_SCAN_X86
+
+#define CMPESTRI_MODE (_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT)
+
+__attribute__((target("sse4.2")))
+static size_t scan_target_sse42(const char *ptr, size_t len) {
+  static const char ranges[16] __attribute__((aligned(16))) = "\x00\x20\x7f\x7f";
+  const __m128i r = _mm_load_si128((const __m128i *)ranges);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)(ptr + i));
+    int idx = _mm_cmpestri(r, 4, b, 16, CMPESTRI_MODE);
+    if (idx != 16) return i + idx;
+  }
+  return i + scan_target_swar(ptr + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t scan_field_value_sse42(const char *ptr, size_t len) {
+  static const char ranges[16] __attribute__((aligned(16))) = "\x00\x08\x0a\x1f\x7f\x7f";
+  const __m128i r = _mm_load_si128((const __m128i *)ranges);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)(ptr + i));
+    int idx = _mm_cmpestri(r, 6, b, 16, CMPESTRI_MODE);
+    if (idx != 16) return i + idx;
+  }
+  return i + scan_field_value_swar(ptr + i, len - i);
+}
+
+// An unsigned b <= n test is done using min(b, n) == b.
+
+__attribute__((target("avx2")))
+static size_t scan_target_avx2(const char *ptr, size_t len) {
+  const __m256i space = _mm256_set1_epi8(0x20);
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)(ptr + i));
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(b, space), b);
+    __m256i hit = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(b, del));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  return i + scan_target_swar(ptr + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_field_value_avx2(const char *ptr, size_t len) {
+  const __m256i us = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)(ptr + i));
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(b, us), b);
+    ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, tab), ctl);
+    __m256i hit = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(b, del));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  return i + scan_field_value_swar(ptr + i, len - i);
+}
+
+#endif /* H1P_SCAN_X86 */
+
+void Init_Scan(void) {
+  scan_target = scan_target_swar;
+  scan_field_value = scan_field_value_swar;
+
+#ifdef H1P_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    scan_target = scan_target_avx2;
+    scan_field_value = scan_field_value_avx2;
+  }
+  else if (__builtin_cpu_supports("sse4.2")) {
+    scan_target = scan_target_sse42;
+    scan_field_value = scan_field_value_sse42;
+  }
+#endif
+}
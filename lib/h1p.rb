@@ -2,6 +2,31 @@
 
 require_relative './h1p_ext'
 
+module H1P
+  # Headers returned by `Parser#parse_headers` in lazy mode
+  class Headers
+    def each(&block)
+      to_h.each(&block)
+    end
+
+    def keys
+      to_h.keys
+    end
+
+    def size
+      to_h.size
+    end
+
+    def ==(other)
+      other.is_a?(Headers) ? to_h == other.to_h : to_h == other
+    end
+
+    def inspect
+      to_h.inspect
+    end
+  end
+end
+
 class ::IO
   if !method_defined?(:__read_method__)
     def __read_method__
@@ -2,6 +2,10 @@
 
 require_relative 'helper'
 require 'h1p'
+require 'tempfile'
+require 'stringio'
+require 'securerandom'
+require 'time'
 
 class SendResponseTest < MiniTest::Test
   def test_send_response_status_line
@@ -19,6 +23,46 @@ class SendResponseTest < MiniTest::Test
     assert_equal "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n".bytesize, count
   end
 
+  def test_send_response_integer_status
+    i, o = IO.pipe
+    H1P.send_response(o, { ':status' => 404 })
+    H1P.send_response(o, { ':status' => 299, ':protocol' => 'HTTP/1.0' })
+    o.close
+    response = i.read
+    assert_equal "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\nHTTP/1.0 299 \r\nContent-Length: 0\r\n\r\n", response
+
+
+    # statuses outside of 100..599 are written as is
+    i, o = IO.pipe
+    H1P.send_response(o, { ':status' => 42 })
+    o.close
+    assert_equal "HTTP/1.1 42\r\nContent-Length: 0\r\n\r\n", i.read
+  end
+
+  def test_send_response_date
+    i, o = IO.pipe
+    H1P.send_response(o, { 'Foo' => 'bar' }, 'foo', date: true)
+    o.close
+    response = i.read
+    assert_match /\AHTTP\/1.1 200 OK\r\nFoo: bar\r\nDate: (.+)\r\nContent-Length: 3\r\n\r\nfoo\z/, response
+    date = response[/Date: (.+)\r\n/, 1]
+    assert_in_delta Time.now.to_i, Time.httpdate(date).to_i, 2
+  end
+
+  def test_send_response_date_big_headers
+    # headers fill the staging buffer to just below its size
+    pad = 'x' * (65536 - 30)
+    i, o = IO.pipe
+    reader = Thread.new { i.read }
+    H1P.send_response(o, { 'X-Pad' => pad }, 'foo', date: true)
+    chunks = ['foo']
+    H1P.send_chunked_response(o, { 'X-Pad' => pad }, date: true) { chunks.shift }
+    o.close
+    response = reader.value
+    assert_equal 2, response.scan(/X-Pad: x+\r\nDate: .+ GMT\r\n/).size
+    assert response.end_with?("3\r\nfoo\r\n0\r\n\r\n")
+  end
+
   def test_send_response_string_headers
     i, o = IO.pipe
     H1P.send_response(o, { 'Foo' => 'Bar', 'X-Blah' => '123' })
@@ -77,6 +121,115 @@ class SendResponseTest < MiniTest::Test
     response = i.read
     assert_equal "HTTP/1.1 200 OK\r\nContent-Length: #{body.bytesize}\r\n\r\n#{body}", response
   end
+
+  def test_send_response_repeated
+    i, o = IO.pipe
+    len1 = H1P.send_response(o, { 'Foo' => 'bar' * 100 }, 'foo')
+    len2 = H1P.send_response(o, { 'Foo' => 'baz' }, 'barbaz')
+    o.close
+    response = i.read
+    expected = "HTTP/1.1 200 OK\r\nFoo: #{'bar' * 100}\r\nContent-Length: 3\r\n\r\nfoo" +
+      "HTTP/1.1 200 OK\r\nFoo: baz\r\nContent-Length: 6\r\n\r\nbarbaz"
+    assert_equal expected, response
+    assert_equal expected.bytesize, len1 + len2
+  end
+
+  def test_send_response_buffered_io
+    Tempfile.create('h1p') do |f|
+      f.sync = false
+      f << 'foo'
+      H1P.send_response(f, {}, 'bar')
+      f << 'baz'
+      f.flush
+      assert_equal "fooHTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nbarbaz", IO.read(f.path)
+    end
+  end
+
+  def test_send_response_body_modified_while_waiting
+    i, o = IO.pipe
+    body = 'x' * (1 << 20)
+    writer = Thread.new { H1P.send_response(o, {}, body) }
+    # the pipe is full, and the writer waits for it to become writable
+    sleep 0.05
+    body[0, body.bytesize] = 'y' * body.bytesize
+    reader = Thread.new { i.read }
+    writer.join
+    o.close
+    response = reader.value
+    assert_equal "HTTP/1.1 200 OK\r\nContent-Length: #{body.bytesize}\r\n\r\n" + ('x' * body.bytesize), response
+  end
+
+  def test_send_response_non_io
+    io = StringIO.new
+    len = H1P.send_response(io, { 'Foo' => 'bar' }, 'foobar')
+    assert_equal "HTTP/1.1 200 OK\r\nFoo: bar\r\nContent-Length: 6\r\n\r\nfoobar", io.string
+    assert_equal io.string.bytesize, len
+
+    # #write is called with a single argument
+    writer = Class.new do
+      attr_reader :writes
+      def initialize; @writes = []; end
+      def write(str); @writes << str.dup; str.bytesize; end
+    end.new
+    len = H1P.send_response(writer, { 'Foo' => 'bar' }, 'foobar')
+    assert_equal ["HTTP/1.1 200 OK\r\nFoo: bar\r\nContent-Length: 6\r\n\r\nfoobar"], writer.writes
+    assert_equal writer.writes.first.bytesize, len
+  end
+end
+
+class HTTPDateTest < MiniTest::Test
+  def test_http_date
+    date = H1P.http_date
+    assert_match /\A[A-Z][a-z]{2}, \d{2} [A-Z][a-z]{2} \d{4} \d{2}:\d{2}:\d{2} GMT\z/, date
+    assert_in_delta Time.now.to_i, Time.httpdate(date).to_i, 2
+    assert date.frozen?
+  end
+
+  def test_http_date_threads
+    dates = 4.times.map { Thread.new { 1000.times.map { H1P.http_date } } }.flat_map(&:value)
+    dates.each { assert_in_delta Time.now.to_i, Time.httpdate(_1).to_i, 2 }
+  end
+end
+
+class ResponseTemplateTest < MiniTest::Test
+  def test_response_template_date
+    template = H1P::ResponseTemplate.new(204, {}, date: true)
+    io = StringIO.new
+    template.send(io, { 'Foo' => 'bar' })
+    assert_match /\AHTTP\/1.1 204 No Content\r\nFoo: bar\r\nDate: .+ GMT\r\nContent-Length: 0\r\n\r\n\z/, io.string
+  end
+
+  def test_response_template
+    template = H1P::ResponseTemplate.new(200, { 'Server' => 'h1p', 'Vary' => ['Accept', 'Origin'] })
+    assert_equal "HTTP/1.1 200 OK\r\nServer: h1p\r\nVary: Accept, Origin\r\n", template.to_s
+    assert template.to_s.frozen?
+
+    i, o = IO.pipe
+    len1 = template.send(o)
+    len2 = template.send(o, { 'Foo' => 'bar' }, 'foobar')
+    o.close
+    response = i.read
+    expected = "HTTP/1.1 200 OK\r\nServer: h1p\r\nVary: Accept, Origin\r\nContent-Length: 0\r\n\r\n" +
+      "HTTP/1.1 200 OK\r\nServer: h1p\r\nVary: Accept, Origin\r\nFoo: bar\r\nContent-Length: 6\r\n\r\nfoobar"
+    assert_equal expected, response
+    assert_equal expected.bytesize, len1 + len2
+  end
+
+  def test_response_template_status
+    assert_equal "HTTP/1.1 404 Not Found\r\n", H1P::ResponseTemplate.new(404).to_s
+    assert_equal "HTTP/1.0 503 Service Unavailable\r\n",
+      H1P::ResponseTemplate.new(503, { ':protocol' => 'HTTP/1.0' }).to_s
+    assert_equal "HTTP/1.1 418 I'm a teapot\r\n", H1P::ResponseTemplate.new('418 I\'m a teapot').to_s
+    assert_equal "HTTP/1.1 1000\r\n", H1P::ResponseTemplate.new(1000).to_s
+  end
+
+  def test_response_template_non_io
+    template = H1P::ResponseTemplate.new(201, { 'Foo' => 'bar' })
+    io = StringIO.new
+    len = template.send(io, nil, 'baz')
+    assert_equal "HTTP/1.1 201 Created\r\nFoo: bar\r\nContent-Length: 3\r\n\r\nbaz", io.string
+    assert_equal io.string.bytesize, len
+  end
 end
 
 class SendBodyChunkTest < MiniTest::Test
@@ -110,6 +263,62 @@ class SendBodyChunkTest < MiniTest::Test
     assert_equal "#{chunk.bytesize.to_s(16)}\r\n#{chunk}\r\n", response
     assert_equal chunk.bytesize + chunk.bytesize.to_s(16).bytesize + 4, len
   end
+
+  def test_send_body_chunk_non_io
+    io = StringIO.new
+    H1P.send_body_chunk(io, 'foo')
+    H1P.send_body_chunk(io, nil)
+    assert_equal "3\r\nfoo\r\n0\r\n\r\n", io.string
+  end
+end
+
+class ChunkedWriterTest < MiniTest::Test
+  def read_available(io)
+    io.read_nonblock(1 << 20, exception: false).then { _1 == :wait_readable ? '' : _1 }
+  end
+
+  def test_chunked_writer
+    i, o = IO.pipe
+    writer = H1P::ChunkedWriter.new(o, { 'Foo' => 'bar' })
+    writer << 'foo'
+    writer.write(:bar)
+    assert_equal '', read_available(i)
+
+    writer.flush
+    assert_equal "HTTP/1.1 200 OK\r\nFoo: bar\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n3\r\nbar\r\n", read_available(i)
+
+    writer << ''
+    writer << 'baz'
+    len = writer.finish
+    assert_equal "3\r\nbaz\r\n0\r\n\r\n", read_available(i)
+    assert_equal "HTTP/1.1 200 OK\r\nFoo: bar\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n3\r\nbar\r\n3\r\nbaz\r\n0\r\n\r\n".bytesize, len
+
+    assert_raises(IOError) { writer << 'foo' }
+    assert_raises(IOError) { writer.finish }
+  end
+
+  def test_chunked_writer_flush_threshold
+    i, o = IO.pipe
+    writer = H1P::ChunkedWriter.new(o, { ':status' => 201 }, flush_threshold: 64)
+    writer << 'foo'
+    assert_equal '', read_available(i)
+
+    chunk = 'x' * 100
+    writer << chunk
+    assert_equal "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n64\r\n#{chunk}", read_available(i)
+
+    writer.finish
+    assert_equal "\r\n0\r\n\r\n", read_available(i)
+  end
+
+  def test_chunked_writer_non_io
+    io = StringIO.new
+    writer = H1P::ChunkedWriter.new(io, {}, date: true)
+    10.times { writer << 'foo' }
+    len = writer.finish
+    assert_match /\AHTTP\/1.1 200 OK\r\nDate: .+ GMT\r\nTransfer-Encoding: chunked\r\n\r\n(3\r\nfoo\r\n){10}0\r\n\r\n\z/, io.string
+    assert_equal io.string.bytesize, len
+  end
 end
 
 class SendChunkedResponseTest < MiniTest::Test
@@ -129,6 +338,13 @@ class SendChunkedResponseTest < MiniTest::Test
     assert_equal len, response.bytesize
   end
 
+  def test_send_chunked_response_date
+    chunks = ['foo']
+    io = StringIO.new
+    H1P.send_chunked_response(io, {}, date: true) { chunks.shift }
+    assert_match /\AHTTP\/1.1 200 OK\r\nDate: .+ GMT\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n0\r\n\r\n\z/, io.string
+  end
+
   def test_send_chunked_response_with_frozen_headers_hash
     isrc, osrc = IO.pipe
     osrc << 'foobarbaz'
@@ -145,4 +361,80 @@ class SendChunkedResponseTest < MiniTest::Test
     assert_equal "HTTP/1.1 200 OK\r\nFoo: bar\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n3\r\nbar\r\n3\r\nbaz\r\n0\r\n\r\n", response
     assert_equal len, response.bytesize
   end
+
+  def with_file(content)
+    Tempfile.create('h1p') do |f|
+      f << content
+      f.flush
+      yield f
+    end
+  end
+
+  def send_file_response(*args, **opts)
+    i, o = IO.pipe
+    reader = Thread.new { i.read }
+    len = H1P.send_file_response(o, *args, **opts)
+    o.close
+    response = reader.value
+    assert_equal len, response.bytesize
+    response
+  end
+
+  def test_send_file_response
+    with_file('foobar') do |f|
+      response = send_file_response({ 'Foo' => 'bar' }, f)
+      assert_equal "HTTP/1.1 200 OK\r\nFoo: bar\r\nContent-Length: 6\r\n\r\nfoobar", response
+
+      response = send_file_response({}, f, offset: 2, length: 3)
+      assert_equal "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\noba", response
+
+      response = send_file_response({}, f, offset: 4, length: 10)
+      assert_equal "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nar", response
+
+      assert_raises(ArgumentError) { H1P.send_file_response(StringIO.new, {}, f, offset: 7) }
+      assert_raises(TypeError) { H1P.send_file_response(StringIO.new, {}, 'foo') }
+    end
+
+    data = SecureRandom.random_bytes(300_000)
+    with_file(data) do |f|
+      response = send_file_response({}, f)
+      assert_equal "HTTP/1.1 200 OK\r\nContent-Length: 300000\r\n\r\n".b + data, response.b
+
+      # non-IO target
+      io = StringIO.new(+'')
+      len = H1P.send_file_response(io, {}, f, offset: 1000)
+      assert_equal "HTTP/1.1 200 OK\r\nContent-Length: 299000\r\n\r\n".b + data[1000..], io.string.b
+      assert_equal io.string.bytesize, len
+    end
+  end
+
+  def test_send_file_response_range
+    with_file('0123456789') do |f|
+      {
+        'bytes=2-4'     => ['2-4', '234'],
+        'bytes=7-'      => ['7-9', '789'],
+        'bytes=-3'      => ['7-9', '789'],
+        'bytes=-20'     => ['0-9', '0123456789'],
+        'bytes=8-100'   => ['8-9', '89'],
+        'Bytes= 0-0 '   => ['0-0', '0']
+      }.each do |range, (content_range, body)|
+        response = send_file_response({}, f, range: range)
+        assert_equal "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes #{content_range}/10\r\nContent-Length: #{body.bytesize}\r\n\r\n#{body}", response
+      end
+
+      ['bytes=10-', 'bytes=20-30', 'bytes=-0'].each do |range|
+        response = send_file_response({}, f, range: range)
+        assert_equal "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */10\r\nContent-Length: 0\r\n\r\n", response
+      end
+
+      ['bytes=4-2', 'bytes=1-2,4-5', 'items=1-2', 'bytes=a-', 'bytes=-'].each do |range|
+        response = send_file_response({}, f, range: range)
+        assert_equal "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n0123456789", response
+      end
+
+      # range relative to the given offset and length
+      response = send_file_response({}, f, offset: 2, length: 5, range: 'bytes=1-')
+      assert_equal "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes 1-4/5\r\nContent-Length: 4\r\n\r\n3456", response
+    end
+  end
 end
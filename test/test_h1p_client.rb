@@ -47,6 +47,25 @@ class H1PClientTest < MiniTest::Test
     )
   end
 
+  def test_lazy_headers
+    msg = "HTTP/1.1 404 Not found\r\nContent-Length: 3\r\nServer: foo\r\n\r\nabc"
+    @o << msg
+    headers = @parser.parse_headers
+    body = @parser.read_body
+
+    i, o = IO.pipe
+    o << msg
+    parser = H1P::Parser.new(i, :client, lazy: true)
+    lazy = parser.parse_headers
+    assert_equal 404, lazy[':status']
+    assert_equal 'Not found', lazy[':status_message']
+    assert_equal 'foo', lazy['server']
+    assert_nil lazy[':method']
+    assert_equal body, parser.read_body
+    assert_equal headers, lazy.to_h
+    assert_equal headers.keys, lazy.to_h.keys
+  end
+
   def test_eof
     @o << "HTTP/1.1 200 OK"
     @o.close
@@ -63,6 +82,15 @@ class H1PClientTest < MiniTest::Test
     @o << "http/1.1 200\r\n\r\n"
     headers = @parser.parse_headers
     assert_equal 'http/1.1', headers[':protocol']
+
+    reset_parser
+    @o << "HTTP/1.0 200 OK\r\n\r\nHttP/1.0 404 Not Found\r\n\r\n"
+    headers1 = @parser.parse_headers
+    headers2 = @parser.parse_headers
+    assert_equal 'http/1.0', headers1[':protocol']
+    assert_equal 'http/1.0', headers2[':protocol']
+    assert_equal 404, headers2[':status']
+    assert_same headers1[':protocol'], headers2[':protocol']
   end
 
   def test_bad_status_line
@@ -80,6 +108,10 @@ class H1PClientTest < MiniTest::Test
     reset_parser
     @o << "HTTP/1.1 200 #{'a' * (max_length + 1)}\r\n\r\n"
     assert_raises(Error) { @parser.parse_headers }
+
+    reset_parser
+    @o << "HTTP/1.1 200 O\x02K\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
   end
 
   def test_path_characters
@@ -260,18 +292,18 @@ class H1PClientTest < MiniTest::Test
     total_sent = 0
     Thread.new do
       msg = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
       rand(8..16).times do |i|
         chunk = i.to_s * rand(200..360000)
         msg = "#{chunk.bytesize.to_s(16)}\r\n#{chunk}\r\n"
-        @o << msg
-        chunks << chunk
         total_sent += msg.bytesize
+        chunks << chunk
+        @o << msg
       end
       msg = "0\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
     end
     headers = @parser.parse_headers
     assert_equal 'chunked', headers['transfer-encoding']
@@ -286,18 +318,18 @@ class H1PClientTest < MiniTest::Test
     total_sent = 0
     Thread.new do
       msg = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
       rand(8..16).times do |i|
         chunk = i.to_s * rand(40000..360000)
         msg = "#{chunk.bytesize.to_s(16)}\r\n#{chunk}\r\n"
-        @o << msg
         total_sent += msg.bytesize
         chunks << chunk
+        @o << msg
       end
       msg = "0\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
     end
     headers = @parser.parse_headers
     assert_equal 'chunked', headers['transfer-encoding']
@@ -529,4 +561,18 @@ class H1PClientTest < MiniTest::Test
     }, headers)
     assert_equal [{len: 4096}, {len: 4096}], buf
   end
+
+  def test_push_mode
+    parser = H1P::Parser.new(nil, :client)
+    response = "HTTP/1.1 200 OK\r\nContent-Length: 6\r\n\r\nfoobar"
+    events = response.each_char.map { parser << _1 }.reject { _1 == :need_more }
+    assert_equal [
+      {
+        ':protocol' => 'http/1.1', ':status' => 200, ':status_message' => 'OK',
+        'content-length' => '6', ':rx' => response.bytesize
+      },
+      'f', 'o', 'o', 'b', 'a', 'r'
+    ], events
+    assert_equal true, parser.complete?
+  end
 end
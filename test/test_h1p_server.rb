@@ -4,7 +4,10 @@ require_relative 'helper'
 require 'h1p'
 require 'socket'
 require_relative '../ext/h1p/limits'
+require_relative '../ext/h1p/header_names'
 require 'securerandom'
+require 'io/nonblock'
+require 'tempfile'
 
 class H1PServerTest < MiniTest::Test
   Error = H1P::Error
@@ -71,6 +74,27 @@ class H1PServerTest < MiniTest::Test
     assert_equal 'POST', headers[':method']
   end
 
+  def test_common_methods
+    %w[GET POST PUT HEAD PATCH DELETE OPTIONS].each do |method|
+      @o << "#{method} / HTTP/1.1\r\n\r\n#{method} /foo HTTP/1.0\r\n\r\n"
+      headers1 = @parser.parse_headers
+      headers2 = @parser.parse_headers
+      assert_equal method, headers1[':method']
+      assert_equal '/', headers1[':path']
+      assert_equal 'http/1.1', headers1[':protocol']
+      assert_equal '/foo', headers2[':path']
+      assert_equal 'http/1.0', headers2[':protocol']
+      assert headers1[':method'].frozen?
+      assert_same headers1[':method'], headers2[':method']
+    end
+
+    @o << "PATCHY / HTTP/1.1\r\n\r\n"
+    assert_equal 'PATCHY', @parser.parse_headers[':method']
+
+    @o << "GETS / HTTP/1.1\r\n\r\n"
+    assert_equal 'GETS', @parser.parse_headers[':method']
+  end
+
   def test_bad_method
     @o << " / HTTP/1.1\r\n\r\n"
     @o.close
@@ -196,6 +220,39 @@ class H1PServerTest < MiniTest::Test
     assert_equal 'ddd', headers['c']
   end
 
+  def test_header_keys_shared
+    msg = "GET / HTTP/1.1\r\n#{H1P_HEADER_NAMES.map { "#{_1.upcase}: foo\r\n" }.join}X-Foo: bar\r\n\r\n"
+    @o << msg
+    @o << msg
+    headers1 = @parser.parse_headers
+    headers2 = @parser.parse_headers
+
+    assert_equal H1P_HEADER_NAMES + ['x-foo'], headers1.keys.reject { _1 =~ /^:/ }
+    headers1.keys.zip(headers2.keys).each do |k1, k2|
+      assert k1.frozen?
+      assert_same k1, k2
+    end
+  end
+
+  def test_headers_reused_hash
+    hash = { 'bar' => 'baz' }
+    @o << "GET /1 HTTP/1.1\r\nFoo: Bar\r\n\r\nGET /2 HTTP/1.1\r\nCookie: a\r\ncookie: b\r\n\r\n"
+    headers = @parser.parse_headers(hash)
+    assert_same hash, headers
+    assert_equal({ ':method' => 'GET', ':path' => '/1', ':protocol' => 'http/1.1', 'foo' => 'Bar', ':rx' => 29 }, hash)
+
+    headers = @parser.parse_headers(hash)
+    assert_same hash, headers
+    assert_equal({ ':method' => 'GET', ':path' => '/2', ':protocol' => 'http/1.1', 'cookie' => ['a', 'b'], ':rx' => 41 }, hash)
+
+    @o.close
+    assert_nil @parser.parse_headers(hash)
+
+    assert_raises(TypeError) { @parser.parse_headers(42) }
+    parser = H1P::Parser.new(@i, :server, lazy: true)
+    assert_raises(ArgumentError) { parser.parse_headers({}) }
+  end
+
   def test_invalid_headers
     @o << "GET / HTTP/1.1\r\n\foo\x02\x78\x83\x02: bar\n\r\n"
     assert_raises(Error) { @parser.parse_headers }
@@ -215,6 +272,10 @@ class H1PServerTest < MiniTest::Test
     @o << "GET / HTTP/1.1\r\na b\r\n\r\n"
     assert_raises(Error) { @parser.parse_headers }
 
+    reset_parser
+    @o << "GET / HTTP/1.1\r\nfoo(bar): baz\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
+
     max_key_length = H1P_LIMITS[:max_header_key_length]
 
     reset_parser
@@ -251,6 +312,44 @@ class H1PServerTest < MiniTest::Test
     assert_raises(Error) { @parser.parse_headers }
   end
 
+  def test_control_characters
+    @o << "GET /foo\x01bar HTTP/1.1\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
+
+    reset_parser
+    @o << "GET /foo\tbar HTTP/1.1\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
+
+    reset_parser
+    @o << "GET / HTTP/1.1\r\nFoo: bar\x00baz\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
+
+    reset_parser
+    @o << "GET / HTTP/1.1\r\nFoo: bar\x7fbaz\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
+
+    reset_parser
+    @o << "GET / HTTP/1.1\r\nFoo: bar\tbaz\r\n\r\n"
+    headers = @parser.parse_headers
+    assert_equal "bar\tbaz", headers['foo']
+  end
+
+  def test_long_tokens_across_reads
+    path = '/' + SecureRandom.alphanumeric(3000)
+    cookie = (1..40).map { |i| "c#{i}=#{SecureRandom.alphanumeric(40)}" }.join('; ')
+    msg = "GET #{path} HTTP/1.1\r\nCookie: #{cookie}\r\nHost: foo\r\n\r\n"
+
+    [1, 7, 31, 33, 1000].each do |segment_size|
+      segments = msg.scan(/.{1,#{segment_size}}/m)
+      parser = H1P::Parser.new(proc { segments.shift }, :server)
+      headers = parser.parse_headers
+      assert_equal path, headers[':path']
+      assert_equal cookie, headers['cookie']
+      assert_equal 'foo', headers['host']
+      assert_equal msg.bytesize, headers[':rx']
+    end
+  end
+
   def test_request_without_cr
     msg = "GET /foo HTTP/1.1\nBar: baz\n\n"
     @o << msg
@@ -323,18 +422,18 @@ class H1PServerTest < MiniTest::Test
     total_sent = 0
     Thread.new do
       msg = "GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
       rand(8..16).times do |i|
         chunk = i.to_s * rand(200..360000)
         msg = "#{chunk.bytesize.to_s(16)}\r\n#{chunk}\r\n"
-        @o << msg
-        chunks << chunk
         total_sent += msg.bytesize
+        chunks << chunk
+        @o << msg
       end
       msg = "0\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
     end
     headers = @parser.parse_headers
     assert_equal 'chunked', headers['transfer-encoding']
@@ -349,18 +448,18 @@ class H1PServerTest < MiniTest::Test
     total_sent = 0
     Thread.new do
       msg = "GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
       rand(8..16).times do |i|
         chunk = i.to_s * rand(40000..360000)
         msg = "#{chunk.bytesize.to_s(16)}\r\n#{chunk}\r\n"
-        @o << msg
         total_sent += msg.bytesize
         chunks << chunk
+        @o << msg
       end
       msg = "0\r\n\r\n"
-      @o << msg
       total_sent += msg.bytesize
+      @o << msg
     end
     headers = @parser.parse_headers
     assert_equal 'chunked', headers['transfer-encoding']
@@ -373,6 +472,52 @@ class H1PServerTest < MiniTest::Test
     assert_equal total_sent, headers[':rx']
   end
 
+  def test_read_body_into
+    data = 'abc' * 20000
+    msg = "POST / HTTP/1.1\r\nContent-Length: #{data.bytesize}\r\n\r\n#{data}"
+    Thread.new { @o << msg }
+    headers = @parser.parse_headers
+
+    buf = +'foo'
+    assert_equal data.bytesize, @parser.read_body_into(buf)
+    assert_equal data, buf
+    assert_equal msg.bytesize, headers[':rx']
+    assert_nil @parser.read_body_into(buf)
+    assert_equal '', buf
+
+    @o << "GET / HTTP/1.1\r\n\r\n"
+    @parser.parse_headers
+    assert_nil @parser.read_body_into(buf)
+  end
+
+  def test_read_body_chunk_into
+    data = 'abc' * 20000
+    msg = "POST / HTTP/1.1\r\nContent-Length: #{data.bytesize}\r\n\r\n#{data}"
+    Thread.new { @o << msg }
+    headers = @parser.parse_headers
+
+    buf = String.new(capacity: 8192)
+    received = +''
+    while (len = @parser.read_body_chunk_into(buf, false))
+      assert_equal len, buf.bytesize
+      assert_operator len, :<=, 8192
+      received << buf
+    end
+    assert_equal data, received
+    assert_equal msg.bytesize, headers[':rx']
+
+    chunks = %w[foo barbaz]
+    @o << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    chunks.each { @o << "#{_1.bytesize.to_s(16)}\r\n#{_1}\r\n" }
+    @o << "0\r\n\r\n"
+    @parser.parse_headers
+    received = []
+    while @parser.read_body_chunk_into(buf, false)
+      received << buf.dup
+    end
+    assert_equal chunks, received
+  end
+
   def test_read_body_with_chunked_encoding_malformed
     Thread.new do
       @o << "GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
@@ -511,6 +656,89 @@ class H1PServerTest < MiniTest::Test
     assert_equal req_headers.bytesize + req_body.bytesize, headers[':rx']
   end
 
+  def test_splice_body_to_native_error
+    @o << "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n"
+    @parser.parse_headers
+
+    r, w = IO.pipe
+    r.close
+    @o << 'AAAAA'
+    assert_raises(Errno::EPIPE) { @parser.splice_body_to(w) }
+
+    # data left in the internal pipe is not sent to the next destination
+    r, w = IO.pipe
+    @o << 'BBBBBCCCCC'
+    @parser.splice_body_to(w)
+    w.close
+    assert_equal 'BBBBBCCCCC', r.read
+  end
+
+  def test_splice_body_to_native_blocking
+    server = TCPServer.new('127.0.0.1', 0)
+    client = TCPSocket.new('127.0.0.1', server.addr[1])
+    conn = server.accept
+    conn.nonblock = false
+    r, w = IO.pipe
+    reader = Thread.new { r.read }
+    Thread.new do
+      client << "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\n"
+      sleep 0.05
+      client << 'abc'
+      sleep 0.05
+      client << 'def'
+    end
+
+    parser = H1P::Parser.new(conn, :server)
+    parser.parse_headers
+    ticks = 0
+    ticker = Thread.new { loop { sleep 0.001; ticks += 1 } }
+    parser.splice_body_to(w)
+    ticker.kill
+    w.close
+    assert_equal 'abcdef', reader.value
+    # other threads run while waiting for data
+    assert_operator ticks, :>, 10
+  ensure
+    [client, conn, server].each { _1&.close }
+  end
+
+  def test_splice_body_to_native
+    req_body = SecureRandom.alphanumeric(300000)
+    r, w = IO.pipe
+    reader = Thread.new { r.read }
+
+    Thread.new do
+      @o << "POST / HTTP/1.1\r\nContent-Length: #{req_body.bytesize}\r\n\r\n"
+      @o << req_body
+      @o << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+      @o << "#{req_body.bytesize.to_s(16)}\r\n#{req_body}\r\n"
+      @o << "3\r\nfoo\r\n0\r\n\r\n"
+    end
+
+    headers = @parser.parse_headers
+    @parser.splice_body_to(w)
+    assert_equal true, @parser.complete?
+
+    headers = @parser.parse_headers
+    @parser.splice_body_to(w)
+    assert_equal true, @parser.complete?
+    w.close
+    assert_equal req_body + req_body + 'foo', reader.value
+
+    # file destination with data buffered by the IO
+    @o << "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\nabc"
+    Thread.new { sleep 0.01; @o << 'def' }
+    Tempfile.create('h1p') do |f|
+      f << 'foo'
+      @parser.parse_headers
+      @parser.splice_body_to(f)
+      f.rewind
+      assert_equal 'fooabcdef', f.read
+    end
+
+    assert_raises(RuntimeError) { @parser.splice_body_to(Object.new) }
+  end
+
   def test_complete?
     @o << "GET / HTTP/1.1\r\n\r\n"
     headers = @parser.parse_headers
@@ -578,6 +806,167 @@ class H1PServerTest < MiniTest::Test
     assert_equal true, @parser.complete?
   end
 
+  def test_lazy_headers
+    msg = "POST /foo HTTP/1.1\r\nHost: example.com\r\nCookie: a=1\r\nX-Foo: bar\r\ncookie: b=2\r\nContent-Length: 3\r\n\r\nabc"
+    @o << msg
+    headers = @parser.parse_headers
+    body = @parser.read_body
+
+    i, o = IO.pipe
+    o << msg
+    parser = H1P::Parser.new(i, :server, lazy: true)
+    lazy = parser.parse_headers
+    assert_kind_of H1P::Headers, lazy
+    assert_equal 'POST', lazy[':method']
+    assert_equal '/foo', lazy[':path']
+    assert_equal 'http/1.1', lazy[':protocol']
+    assert_equal 'example.com', lazy['host']
+    assert_equal 'bar', lazy['x-foo']
+    assert_equal ['a=1', 'b=2'], lazy['cookie']
+    assert_nil lazy['X-Foo']
+    assert_nil lazy['blah']
+    assert_nil lazy[':status']
+    assert_same lazy['host'], lazy['host']
+    assert lazy['host'].frozen?
+    assert_equal true, lazy.key?('host')
+    assert_equal false, lazy.key?('blah')
+
+    assert_equal body, parser.read_body
+    assert_equal msg.bytesize, lazy[':rx']
+    assert_equal headers, lazy.to_h
+    assert_equal headers.keys, lazy.to_h.keys
+    assert_equal lazy, headers
+
+    lazy['x-foo'] = 'baz'
+    lazy['x-bar'] = 'qux'
+    assert_equal 'baz', lazy['x-foo']
+    assert_equal 'qux', lazy.to_h['x-bar']
+  end
+
+  def test_lazy_headers_eof
+    parser = H1P::Parser.new(@i, :server, lazy: true)
+    @o << "GET / HTTP/1.1\r\nFoo: bar"
+    @o.close
+    assert_nil parser.parse_headers
+
+    assert_raises(ArgumentError) { H1P::Parser.new(@i, :server, foo: true) }
+  end
+
+  def test_parse_buffered_requests
+    assert_equal [], @parser.parse_buffered_requests
+
+    @o << "GET /1 HTTP/1.1\r\n\r\n" +
+          "POST /2 HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc" +
+          "GET /3 HTTP/1.1\r\nHost: foo\r\n\r\n" +
+          "GET /4 HTTP/1.1\r\nHo"
+    headers = @parser.parse_headers
+    assert_equal '/1', headers[':path']
+
+    requests = @parser.parse_buffered_requests
+    assert_equal [
+      [{ ':method' => 'POST', ':path' => '/2', ':protocol' => 'http/1.1', 'content-length' => '3', ':rx' => 42 }, 'abc'],
+      [{ ':method' => 'GET', ':path' => '/3', ':protocol' => 'http/1.1', 'host' => 'foo', ':rx' => 30 }, nil]
+    ], requests
+    assert_equal [], @parser.parse_buffered_requests
+
+    @o << "st: bar\r\n\r\n"
+    headers = @parser.parse_headers
+    assert_equal '/4', headers[':path']
+    assert_equal 'bar', headers['host']
+    assert_equal 30, headers[':rx']
+
+    # incomplete body and chunked bodies are left for parse_headers/read_body
+    @o << "POST /5 HTTP/1.1\r\nContent-Length: 6\r\n\r\nabc"
+    assert_equal [], @parser.parse_buffered_requests
+    headers = @parser.parse_headers
+    assert_equal [], @parser.parse_buffered_requests
+    @o << "def"
+    assert_equal 'abcdef', @parser.read_body
+
+    @o << "POST /6 HTTP/1.1\r\nContent-Length: 0\r\n\r\n" +
+          "POST /7 HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n0\r\n\r\n"
+    headers = @parser.parse_headers
+    assert_equal '/6', headers[':path']
+    assert_nil @parser.read_body
+    assert_equal [], @parser.parse_buffered_requests
+    headers = @parser.parse_headers
+    assert_equal '/7', headers[':path']
+    assert_equal 'foo', @parser.read_body
+
+    @o << "GET /8 HTTP/1.1\r\n\r\nGET /9 HTTP/1.1\r\nFoo bar\r\n\r\n"
+    @parser.parse_headers
+    assert_raises(Error) { @parser.parse_buffered_requests }
+  end
+
+  def test_parse_buffered_requests_lazy
+    parser = H1P::Parser.new(@i, :server, lazy: true)
+    @o << "GET /1 HTTP/1.1\r\n\r\nGET /2 HTTP/1.1\r\nHost: foo\r\n\r\n"
+    parser.parse_headers
+    requests = parser.parse_buffered_requests
+    assert_equal 1, requests.size
+    assert_kind_of H1P::Headers, requests[0][0]
+    assert_equal 'foo', requests[0][0]['host']
+  end
+
+  def test_parse_buffered_requests_rewind
+    global_requests = H1P.stats[:requests]
+    @o << "GET /1 HTTP/1.1\r\n\r\n" +
+          "GET /2 HTTP/1.0\r\n\r\n" +
+          "POST /3 HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n0\r\n\r\n"
+    @parser.parse_headers
+    assert_equal 1, @parser.parse_buffered_requests.size
+    assert_equal 2, @parser.stats[:requests]
+    # the state of the last parsed message is kept
+    assert_equal false, @parser.keep_alive?
+    assert_nil @parser.read_body
+
+    # the chunked message is counted once it is actually parsed
+    assert_equal [], @parser.parse_buffered_requests
+    assert_equal 2, @parser.stats[:requests]
+    headers = @parser.parse_headers
+    assert_equal '/3', headers[':path']
+    assert_equal 'foo', @parser.read_body
+    assert_equal 3, @parser.stats[:requests]
+    assert_equal global_requests + 3, H1P.stats[:requests]
+  end
+
+  def test_io_buffered_data
+    # data already in the IO's internal buffer should be read before the fd
+    @o << "ET / HTTP/1.1\r\nFoo: bar\r\n\r\n"
+    @i.ungetc('G')
+    headers = @parser.parse_headers
+    assert_equal 'GET', headers[':method']
+    assert_equal 'bar', headers['foo']
+
+    @o << "GET /2 HTTP/1.1\r\n\r\n"
+    headers = @parser.parse_headers
+    assert_equal '/2', headers[':path']
+  end
+
+  def test_blocking_io
+    i, o = IO.pipe
+    i.nonblock = false
+    parser = H1P::Parser.new(i, :server)
+
+    # the writer can only run if the GVL is released while blocking in read
+    writer = Thread.new do
+      sleep 0.02
+      o << "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\nabc"
+      sleep 0.02
+      o << 'def'
+    end
+    headers = parser.parse_headers
+    assert_equal 'POST', headers[':method']
+    assert_equal 'abcdef', parser.read_body
+    writer.join
+
+    # a thread blocked in read can be interrupted
+    reader = Thread.new { parser.parse_headers }
+    sleep 0.02
+    reader.kill
+    assert_equal reader, reader.join(1)
+  end
+
   def test_parser_with_tcp_socket
     port = rand(1234..5678)
     server = TCPServer.new('127.0.0.1', port)
@@ -646,4 +1035,628 @@ class H1PServerTest < MiniTest::Test
     }, headers)
     assert_equal [{len: 4096}, {len: 4096}], buf
   end
+
+  def push_events(parser, data, segment_size)
+    events = []
+    data.bytes.each_slice(segment_size) do |segment|
+      event = parser << segment.pack('C*')
+      while event != :need_more
+        # coalesce consecutive body data
+        if event.is_a?(String) && events.last.is_a?(String)
+          events.last << event
+        else
+          events << (event.is_a?(String) ? +event : event)
+        end
+        event = parser << ''
+      end
+    end
+    events
+  end
+
+  def test_push_mode
+    msg1 = "GET /foo HTTP/1.1\r\nHost: bar\r\nContent-Length: 6\r\n\r\nfoobar"
+    msg2 = "POST /baz HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n5\r\ndefgh\r\n0\r\n\r\n"
+    msg3 = "GET / HTTP/1.0\r\n\r\n"
+    data = msg1 + msg2 + msg3
+
+    [1, 2, 5, 16, data.bytesize].each do |segment_size|
+      parser = H1P::Parser.new(nil, :server)
+      events = push_events(parser, data, segment_size)
+      assert_equal [
+        {
+          ':method' => 'GET', ':path' => '/foo', ':protocol' => 'http/1.1',
+          'host' => 'bar', 'content-length' => '6', ':rx' => msg1.bytesize
+        },
+        'foobar',
+        {
+          ':method' => 'POST', ':path' => '/baz', ':protocol' => 'http/1.1',
+          'transfer-encoding' => 'chunked', ':rx' => msg2.bytesize
+        },
+        'abcdefgh',
+        { ':method' => 'GET', ':path' => '/', ':protocol' => 'http/1.0', ':rx' => msg3.bytesize }
+      ], events, "segment size: #{segment_size}"
+      assert_equal true, parser.complete?
+    end
+  end
+
+  def test_push_mode_partial
+    parser = H1P::Parser.new(nil, :server)
+    assert_equal :need_more, parser << "GET /foo HT"
+    assert_equal :need_more, parser << "TP/1.1\r\nContent-Len"
+    assert_equal :need_more, parser << "gth: 10\r\n"
+    headers = parser << "\r\n0123"
+    assert_equal '10', headers['content-length']
+    assert_equal false, parser.complete?
+
+    assert_equal '0123', parser << ''
+    assert_equal :need_more, parser << ''
+    assert_equal '456789', parser << '456789'
+    assert_equal true, parser.complete?
+    assert_equal 51, headers[':rx']
+  end
+
+  def test_push_mode_lazy
+    parser = H1P::Parser.new(nil, :server, lazy: true)
+    data = "GET /foo HTTP/1.1\r\nHost: bar\r\nX-Foo: #{'x' * 1000}\r\n\r\n" * 10
+    events = push_events(parser, data, 7)
+    assert_equal 10, events.size
+    events.each do |headers|
+      assert_kind_of H1P::Headers, headers
+      assert_equal '/foo', headers[':path']
+      assert_equal 'x' * 1000, headers['x-foo']
+    end
+  end
+
+  def test_push_mode_errors
+    parser = H1P::Parser.new(nil, :server)
+    assert_raises(H1P::Error) { parser << "GET / HTTP/1.1\r\nFoo bar\r\n\r\n" }
+
+    parser = H1P::Parser.new(nil, :server)
+    assert_raises(H1P::Error) { parser << 'x' * 10000 }
+
+    parser = H1P::Parser.new(nil, :server)
+    parser << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    assert_raises(H1P::Error) { parser << "3x\r\n" }
+
+    assert_raises(RuntimeError) { H1P::Parser.new(@i, :server) << 'foo' }
+  end
+
+  def test_stats
+    stats = @parser.stats
+    assert_equal 0, stats[:requests]
+    assert_equal({ start_line: 0, header: 0, body: 0, incomplete_body: 0 }, stats[:errors])
+
+    global_requests = H1P.stats[:requests]
+    msg1 = "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\nfoobar"
+    msg2 = "GET /foo HTTP/1.1\r\n\r\n"
+    @o << msg1 << msg2
+    @o.close
+
+    @parser.parse_headers
+    assert_equal 'foobar', @parser.read_body
+    @parser.parse_headers
+    assert_nil @parser.parse_headers
+
+    stats = @parser.stats
+    assert_equal 2, stats[:requests]
+    assert_equal (msg1 + msg2).bytesize, stats[:bytes_read]
+    assert_equal 6, stats[:body_bytes_read]
+    assert_equal 0, stats[:body_bytes_spliced]
+    assert_operator stats[:reads], :>=, 2
+    assert_operator stats[:buffer_refills], :>=, 1
+    assert_operator stats[:buffer_high_water], :>=, (msg1 + msg2).bytesize
+    assert_equal 2, H1P.stats[:requests] - global_requests
+
+    reset_parser
+    global_errors = H1P.stats[:errors][:start_line]
+    @o << "GET / HTTP/1.1 foo\r\n\r\n"
+    assert_raises(Error) { @parser.parse_headers }
+    assert_equal 1, @parser.stats[:errors][:start_line]
+    assert_equal 1, H1P.stats[:errors][:start_line] - global_errors
+
+    reset_parser
+    @o << "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\nfoo"
+    @o.close
+    @parser.parse_headers
+    assert_raises(Error) { @parser.read_body }
+    assert_equal 1, @parser.stats[:errors][:incomplete_body]
+  end
+
+  def test_stats_push_mode
+    parser = H1P::Parser.new(nil, :server)
+    data = "GET / HTTP/1.1\r\nHost: foo\r\n\r\n" * 3
+    push_events(parser, data, 10)
+    stats = parser.stats
+    assert_equal 3, stats[:requests]
+    assert_equal data.bytesize, stats[:bytes_read]
+    assert_equal (data.bytesize / 10.0).ceil, stats[:reads]
+  end
+
+  def test_timings
+    assert_nil @parser.timings
+
+    parser = H1P::Parser.new(@i, :server, timings: true)
+    assert_equal({ first_byte: nil, headers_done: nil, body_done: nil }, parser.timings)
+
+    t0 = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    @o << "POST / HTTP/1.1\r\nContent-Length: 6\r\n\r\nfoo"
+    parser.parse_headers
+    timings = parser.timings
+    assert_operator timings[:first_byte], :>=, t0
+    assert_operator timings[:headers_done], :>=, timings[:first_byte]
+    assert_nil timings[:body_done]
+
+    @o << 'bar'
+    assert_equal 'foobar', parser.read_body
+    timings = parser.timings
+    assert_operator timings[:body_done], :>=, timings[:headers_done]
+    assert_operator timings[:body_done], :<=, Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+    @o << "GET / HTTP/1.1\r\n\r\n"
+    parser.parse_headers
+    timings = parser.timings
+    assert_operator timings[:first_byte], :>, t0
+    assert_operator timings[:body_done], :>=, timings[:headers_done]
+  end
+
+  def test_timings_push_mode
+    parser = H1P::Parser.new(nil, :server, timings: true)
+    assert_equal :need_more, parser << "POST / HTTP/1.1\r\n"
+    first_byte = parser.timings[:first_byte]
+    refute_nil first_byte
+    assert_nil parser.timings[:headers_done]
+
+    parser << "Content-Length: 3\r\n\r\n"
+    assert_equal 'foo', parser << 'foo'
+    timings = parser.timings
+    assert_equal first_byte, timings[:first_byte]
+    assert_operator timings[:headers_done], :>=, first_byte
+    assert_operator timings[:body_done], :>=, timings[:headers_done]
+
+    assert_equal :need_more, parser << ''
+    assert_equal({ first_byte: nil, headers_done: nil, body_done: nil }, parser.timings)
+  end
+
+  def test_adaptive_read_size
+    lens = []
+    big = "GET / HTTP/1.1\r\n#{(1..30).map { "X-Foo-#{_1}: #{'x' * 1500}\r\n" }.join}\r\n"
+    small = "GET / HTTP/1.1\r\n\r\n"
+    chunks = big.scan(/.{1,4096}/m) + [small] * 6
+    parser = H1P::Parser.new(proc { |len| lens << len; chunks.shift }, :server)
+
+    headers = parser.parse_headers
+    assert_equal 1500, headers['x-foo-30'].bytesize
+    assert_equal 4096, lens.first
+    assert_operator lens.max, :>, 4096
+    assert_operator lens.max, :<=, 65536
+    assert_equal lens.sort, lens
+
+    6.times { assert_equal '/', parser.parse_headers[':path'] }
+    assert_equal 4096, lens.last
+
+    lens.clear
+    chunks = big.scan(/.{1,1024}/m)
+    parser = H1P::Parser.new(proc { |len| lens << len; chunks.shift }, :server, min_buffer_size: 1024, max_read_size: 2048)
+    assert_equal 1500, parser.parse_headers['x-foo-30'].bytesize
+    assert_equal [1024, 2048], lens.uniq
+
+    assert_raises(ArgumentError) { H1P::Parser.new(@i, :server, min_buffer_size: 10) }
+    assert_raises(ArgumentError) { H1P::Parser.new(@i, :server, min_buffer_size: 8192, max_read_size: 4096) }
+  end
+
+  def test_buffer_shrink_after_small_messages
+    require 'objspace'
+    big = "GET / HTTP/1.1\r\n#{(1..30).map { "X-Foo-#{_1}: #{'x' * 1500}\r\n" }.join}\r\n"
+    small = "GET / HTTP/1.1\r\n\r\n"
+    # the last read of the large message includes the start of the next one
+    chunks = (big + small).scan(/.{1,4096}/m) + [small] * 8
+    parser = H1P::Parser.new(proc { chunks.shift }, :server)
+    buffer_capacity = -> do
+      buf = ObjectSpace.reachable_objects_from(parser).find { _1.is_a?(String) && !_1.frozen? }
+      ObjectSpace.memsize_of(buf)
+    end
+
+    assert_equal 1500, parser.parse_headers['x-foo-30'].bytesize
+    assert_operator buffer_capacity.(), :>, 32768
+
+    # the read size decays with small messages, and the empty buffer is shrunk
+    # accordingly at message boundaries
+    9.times { assert_equal '/', parser.parse_headers[':path'] }
+    assert_operator buffer_capacity.(), :<, 16384
+  end
+
+  def test_buffer_pool
+    pool = H1P::BufferPool.new(sizes: [1024, 4096], max_free: 2)
+    assert_equal [
+      { size: 1024, free: 0, in_use: 0, allocated: 0 },
+      { size: 4096, free: 0, in_use: 0, allocated: 0 }
+    ], pool.stats
+
+    parser = H1P::Parser.new(@i, :server, buffer_pool: pool)
+    @o << "POST / HTTP/1.1\r\nContent-Length: 3\r\n\r\nfoo"
+    headers = parser.parse_headers
+    assert_equal '/', headers[':path']
+    assert_equal({ size: 4096, free: 0, in_use: 1, allocated: 1 }, pool.stats[1])
+    assert_equal 'foo', parser.read_body
+
+    # the consumed buffer is returned to the pool before the next read
+    @o << "GET /bar HTTP/1.1\r\n\r\n"
+    assert_equal '/bar', parser.parse_headers[':path']
+    assert_equal({ size: 4096, free: 0, in_use: 1, allocated: 1 }, pool.stats[1])
+
+    @o.close
+    assert_nil parser.parse_headers
+    assert_equal({ size: 4096, free: 1, in_use: 0, allocated: 1 }, pool.stats[1])
+  end
+
+  def test_buffer_pool_parser_freed
+    pool = H1P::BufferPool.new(sizes: [4096], max_free: 2)
+    # the parser is created in a separate thread, so that it is not kept alive
+    # by references on the stack
+    Thread.new do
+      i, o = IO.pipe
+      o << "GET / HTTP/1.1\r\nHost: fo"
+      o.close
+      parser = H1P::Parser.new(i, :server, buffer_pool: pool)
+      # EOF in the middle of the headers
+      assert_nil parser.parse_headers
+      i.close
+    end.join
+    assert_equal 1, pool.stats[0][:in_use]
+
+    # a borrowed buffer is accounted for when the parser is freed
+    GC.start
+    assert_equal 0, pool.stats[0][:in_use]
+  end
+
+  def test_buffer_pool_push_mode
+    pool = H1P::BufferPool.new(sizes: [1024, 4096], max_free: 1)
+    parsers = 3.times.map { H1P::Parser.new(nil, :server, buffer_pool: pool, min_buffer_size: 1024) }
+
+    parsers.each { assert_equal :need_more, _1 << "GET / HTTP/1.1\r\n" }
+    assert_equal({ size: 1024, free: 0, in_use: 3, allocated: 3 }, pool.stats[0])
+
+    parsers.each do |parser|
+      assert_kind_of Hash, parser << "Host: foo\r\n\r\n"
+      assert_equal :need_more, parser << ''
+    end
+    # only max_free buffers are kept
+    assert_equal({ size: 1024, free: 1, in_use: 0, allocated: 3 }, pool.stats[0])
+
+    data = "GET /#{'x' * 2000} HTTP/1.1\r\n\r\n"
+    assert_equal '/' + 'x' * 2000, (parsers[0] << data)[':path']
+    assert_equal 1, pool.stats[1][:allocated]
+
+    assert_raises(ArgumentError) { H1P::BufferPool.new(sizes: [4096, 1024]) }
+    assert_raises(ArgumentError) { H1P::BufferPool.new(sizes: []) }
+    assert_raises(ArgumentError) { H1P::Parser.new(nil, :server, buffer_pool: :foo) }
+  end
+
+  def test_ring_buffer
+    parser = H1P::Parser.new(@i, :server, ring_buffer: 4096)
+    requests = 100.times.map do |i|
+      "POST /#{i} HTTP/1.1\r\nX-Foo: #{'x' * (i * 7 + 1)}\r\nContent-Length: #{i}\r\n\r\n#{'b' * i}"
+    end
+    writer = Thread.new do
+      requests.join.bytes.each_slice(1000) { @o << _1.pack('C*') }
+      @o.close
+    end
+
+    100.times do |i|
+      headers = parser.parse_headers
+      assert_equal "/#{i}", headers[':path']
+      assert_equal 'x' * (i * 7 + 1), headers['x-foo']
+      assert_equal 'b' * i, parser.read_body if i > 0
+    end
+    assert_nil parser.parse_headers
+    assert_equal 0, parser.stats[:buffer_bytes_moved]
+  ensure
+    writer&.join
+  end
+
+  def test_ring_buffer_growth
+    parser = H1P::Parser.new(@i, :server, ring_buffer: 4096)
+    msg = "GET / HTTP/1.1\r\n#{(1..10).map { "X-Foo-#{_1}: #{'x' * 1500}\r\n" }.join}\r\n"
+    writer = Thread.new { @o << msg << msg; @o.close }
+
+    2.times do
+      headers = parser.parse_headers
+      assert_equal 'x' * 1500, headers['x-foo-10']
+    end
+    assert_nil parser.parse_headers
+    assert_operator parser.stats[:buffer_high_water], :>=, msg.bytesize
+  ensure
+    writer&.join
+  end
+
+  def test_ring_buffer_large_chunked_body
+    chunk = "400\r\n#{'x' * 1024}\r\n"
+    count = 20 * 1024
+    head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+
+    [:read_body, :splice_body_to].each do |method|
+      i, o = IO.pipe
+      parser = H1P::Parser.new(i, :server, ring_buffer: true)
+      writer = Thread.new { o << head; count.times { o << chunk }; o << "0\r\n\r\n"; o.close }
+      parser.parse_headers
+      if method == :read_body
+        assert_equal count * 1024, parser.read_body.bytesize
+      else
+        File.open(File::NULL, 'w') { parser.splice_body_to(_1) }
+      end
+      assert_equal true, parser.complete?
+      assert_operator parser.stats[:buffer_high_water], :<=, 1 << 16
+      writer.join
+    end
+  end
+
+  def test_framing_metadata
+    @o << "POST / HTTP/1.1\r\nContent-Length: 3\r\nExpect: 100-continue\r\n\r\nfoo"
+    @parser.parse_headers
+    assert_equal 3, @parser.content_length
+    assert_equal false, @parser.chunked?
+    assert_equal true, @parser.keep_alive?
+    assert_equal false, @parser.upgrade?
+    assert_equal true, @parser.expect_continue?
+    assert_equal 'foo', @parser.read_body
+
+    @o << "POST / HTTP/1.1\r\nTransfer-Encoding: gzip, Chunked\r\nConnection: close\r\n\r\n3\r\nfoo\r\n0\r\n\r\n"
+    @parser.parse_headers
+    assert_nil @parser.content_length
+    assert_equal true, @parser.chunked?
+    assert_equal false, @parser.keep_alive?
+    assert_equal false, @parser.expect_continue?
+    assert_equal 'foo', @parser.read_body
+
+    @o << "GET / HTTP/1.0\r\n\r\n"
+    @parser.parse_headers
+    assert_equal false, @parser.keep_alive?
+    assert_equal true, @parser.complete?
+
+    @o << "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"
+    @parser.parse_headers
+    assert_equal true, @parser.keep_alive?
+
+    @o << "GET /ws HTTP/1.1\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n\r\n"
+    @parser.parse_headers
+    assert_equal true, @parser.upgrade?
+    assert_equal true, @parser.keep_alive?
+
+    @o << "GET / HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n"
+    @parser.parse_headers
+    assert_equal false, @parser.chunked?
+    assert_equal true, @parser.complete?
+  end
+
+  def test_framing_invalid_content_length
+    @o << "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nfoo"
+    @parser.parse_headers
+    assert_raises(Error) { @parser.content_length }
+    assert_raises(Error) { @parser.read_body }
+
+    reset_parser
+    @o << "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\nfoo"
+    @parser.parse_headers
+    assert_raises(Error) { @parser.read_body }
+
+    reset_parser
+    @o << "POST / HTTP/1.1\r\nContent-Length: 3\r\ncontent-length: 3\r\n\r\nfoo"
+    @parser.parse_headers
+    assert_equal 3, @parser.content_length
+  end
+
+  def test_large_content_length
+    @o << "POST / HTTP/1.1\r\nContent-Length: 50000000000\r\n\r\nfoo"
+    @parser.parse_headers
+    assert_equal 50_000_000_000, @parser.content_length
+    assert_equal 'foo', @parser.read_body_chunk(true)
+    assert_equal false, @parser.complete?
+
+    reset_parser
+    @o << "POST / HTTP/1.1\r\nContent-Length: 9223372036854775808\r\n\r\nfoo"
+    @parser.parse_headers
+    assert_raises(Error) { @parser.read_body }
+  end
+
+  def test_large_chunk_size
+    parser = H1P::Parser.new(nil, :server)
+    parser << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    assert_equal 'foo', parser << "140000000\r\nfoo"
+    assert_equal false, parser.complete?
+
+    parser = H1P::Parser.new(nil, :server)
+    parser << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    assert_equal 'foo', parser << "fffffffffffffff\r\nfoo"
+
+    parser = H1P::Parser.new(nil, :server)
+    parser << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    assert_raises(Error) { parser << "1000000000000000\r\nfoo" }
+  end
+
+  def test_splice_body_to_large_content_length
+    size = (1 << 31) + 3
+    head = "POST / HTTP/1.1\r\nContent-Length: #{size}\r\n\r\n"
+    chunk = ('x' * (1 << 20)).freeze
+    left = size
+    reader = proc do
+      next nil if left == 0
+      data = left < chunk.bytesize ? chunk[0, left] : chunk
+      left -= data.bytesize
+      data
+    end
+    parser = H1P::Parser.new(proc { head ? head.tap { head = nil } : reader.() }, :server)
+    headers = parser.parse_headers
+    File.open(File::NULL, 'w') { parser.splice_body_to(_1) }
+    assert_equal true, parser.complete?
+    assert_equal "POST / HTTP/1.1\r\nContent-Length: #{size}\r\n\r\n".bytesize + size, headers[':rx']
+  end
+
+  def test_read_body_into_large_body
+    size = (1 << 31) + (1 << 20) + 3
+    chunk = ('x' * (1 << 20)).freeze
+    # a preallocated buffer is used to avoid doubling its capacity
+    buf = String.new(capacity: size)
+    # returns the segments given by the block, split into reads of up to 64KB,
+    # so that chunks span multiple reads
+    reader = ->(&block) do
+      pending = ''
+      proc do |maxlen|
+        pending = block.() if pending&.empty?
+        next nil unless pending
+        len = [maxlen, 65536].min
+        pending.byteslice(0, len).tap { pending = pending.byteslice(len..) || '' }
+      end
+    end
+
+    # content length
+    head = "POST / HTTP/1.1\r\nContent-Length: #{size}\r\n\r\n"
+    left = size
+    parser = H1P::Parser.new(reader.() do
+      next head.tap { head = nil } if head
+      next nil if left == 0
+      data = left < chunk.bytesize ? chunk[0, left] : chunk
+      left -= data.bytesize
+      data
+    end, :server)
+    parser.parse_headers
+    assert_equal size, parser.read_body_into(buf)
+    assert_equal size, buf.bytesize
+    assert_equal true, parser.complete?
+
+    # chunked encoding
+    head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    chunk_msg = "#{chunk.bytesize.to_s(16)}\r\n#{chunk}\r\n".freeze
+    left = size
+    parser = H1P::Parser.new(reader.() do
+      next head.tap { head = nil } if head
+      next nil if left < 0
+      if left == 0
+        left = -1
+        next "0\r\n\r\n"
+      end
+      next chunk_msg.tap { left -= chunk.bytesize } if left >= chunk.bytesize
+      "#{left.to_s(16)}\r\n#{'x' * left}\r\n".tap { left = 0 }
+    end, :server)
+    parser.parse_headers
+    assert_equal size, parser.read_body_into(buf)
+    assert_equal size, buf.bytesize
+    assert_equal 'xxx', buf[-3..]
+    assert_equal true, parser.complete?
+  end
+
+  def test_chunk_extensions
+    msg = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" \
+          "3;foo=bar\r\nabc\r\n5 ; name=\"quoted \\\"x\\\"; y\" ;flag\r\ndefgh\r\n0;last\r\n\r\n"
+    @o << msg
+    headers = @parser.parse_headers
+    assert_equal 'abcdefgh', @parser.read_body
+    assert_equal msg.bytesize, headers[':rx']
+    assert_nil @parser.trailers
+
+    ["3;\r\n", "3 x\r\n", "3;a=\r\n", "3;a=\"b\r\n"].each do |chunk_header|
+      reset_parser
+      @o << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n#{chunk_header}abc\r\n0\r\n\r\n"
+      @parser.parse_headers
+      assert_raises(Error, chunk_header) { @parser.read_body }
+    end
+  end
+
+  def test_trailers
+    msg = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" \
+          "3\r\nabc\r\n0\r\nX-Checksum: 1234 \r\nX-Foo: 1\r\nx-foo:2\r\n\r\n"
+    @o << msg + "GET / HTTP/1.1\r\n\r\n"
+    headers = @parser.parse_headers
+    assert_equal 'abc', @parser.read_body
+    assert_equal msg.bytesize, headers[':rx']
+    assert_equal true, @parser.complete?
+    assert_equal({ 'x-checksum' => '1234', 'x-foo' => ['1', '2'] }, @parser.trailers)
+
+    headers = @parser.parse_headers
+    assert_equal '/', headers[':path']
+    assert_nil @parser.trailers
+
+    reset_parser
+    @o << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\nfoo bar\r\n\r\n"
+    @parser.parse_headers
+    assert_raises(Error) { @parser.read_body }
+
+    i, o = IO.pipe
+    parser = H1P::Parser.new(i, :server)
+    o << "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\nX-Foo: bar\r\n\r\n"
+    parser.parse_headers
+    File.open(File::NULL, 'w') { parser.splice_body_to(_1) }
+    assert_equal({ 'x-foo' => 'bar' }, parser.trailers)
+  end
+
+  def test_trailers_limits
+    head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n"
+    max_header_count = H1P_LIMITS[:max_header_count]
+    repeated = "X-Foo: 1\r\n" * (max_header_count + 1) + "\r\n"
+    oversized = "X-Foo: #{'x' * 2000}\r\n" * 40 + "\r\n"
+
+    i, o = IO.pipe
+    parser = H1P::Parser.new(i, :server)
+    o << head << "X-Foo: 1\r\n" * max_header_count << "\r\n"
+    parser.parse_headers
+    assert_equal 'abc', parser.read_body
+    assert_equal max_header_count, parser.trailers['x-foo'].size
+
+    [[repeated, /Too many trailers/], [oversized, /Trailers too large/]].each do |trailers, message|
+      i, o = IO.pipe
+      parser = H1P::Parser.new(i, :server)
+      Thread.new { o << head << trailers rescue nil }
+      parser.parse_headers
+      e = assert_raises(Error) { parser.read_body }
+      assert_match message, e.message
+
+      parser = H1P::Parser.new(nil, :server)
+      parser << head
+      e = assert_raises(Error) { push_events(parser, trailers, 1000) }
+      assert_match message, e.message
+    end
+  end
+
+  def test_trailers_push_mode
+    msg = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" \
+          "3;ext=1\r\nabc\r\n0\r\nX-Checksum: 1234\r\n\r\n"
+    data = msg + "GET / HTTP/1.1\r\n\r\n"
+
+    [1, 3, 7, data.bytesize].each do |segment_size|
+      parser = H1P::Parser.new(nil, :server)
+      events = push_events(parser, data, segment_size)
+      assert_equal 3, events.size, "segment size: #{segment_size}"
+      assert_equal msg.bytesize, events[0][':rx']
+      assert_equal 'abc', events[1]
+      assert_equal '/', events[2][':path']
+      assert_nil parser.trailers
+    end
+
+    parser = H1P::Parser.new(nil, :server)
+    parser << msg
+    assert_equal 'abc', parser << ''
+    assert_equal :need_more, parser << ''
+    assert_equal true, parser.complete?
+    assert_equal({ 'x-checksum' => '1234' }, parser.trailers)
+  end
+
+  def test_buffered_chunks
+    chunks = (1..500).map { |i| ('a'.ord + i % 26).chr * (i % 37 + 1) }
+    body = chunks.map { |c| "#{c.bytesize.to_s(16)}\r\n#{c}\r\n" }.join
+    msg = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n#{body}0\r\n\r\n"
+
+    [msg.bytesize, 1000, 17].each do |read_size|
+      data = msg.dup
+      parser = H1P::Parser.new(proc { |len| data.empty? ? nil : data.slice!(0, [len, read_size].min) }, :server)
+      headers = parser.parse_headers
+      assert_equal chunks.join, parser.read_body, "read size: #{read_size}"
+      assert_equal msg.bytesize, headers[':rx']
+      assert_equal true, parser.complete?
+    end
+
+    Thread.new { @o << msg }
+    @parser.parse_headers
+    buf = +'foo'
+    assert_equal chunks.join.bytesize, @parser.read_body_into(buf)
+    assert_equal chunks.join, buf
+  end
 end